@@ -1,13 +1,17 @@
 #ifndef INITIAL_CONDITION_H
 #define INITIAL_CONDITION_H
 
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 #include <yaml-cpp/yaml.h>
 #include <armadillo>
 
+#include "Misc.h"
 #include "RegisterSubclass.h"
 
 namespace InitialCondition {
@@ -37,18 +41,47 @@ class Base {
        public:
 	static const auto& get_factories() { return factories(); }
 	virtual State roll() = 0;
+	// State of spin index out of count spins. Point sets map every index to
+	// its own point, the other initial conditions just call roll().
+	virtual State roll(size_t index, size_t count) = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
 	virtual ~Base() {}
 };
 
+namespace detail {
+
+template <typename T, typename = void>
+struct has_indexed_roll : std::false_type {};
+
+template <typename T>
+struct has_indexed_roll<T, Misc::void_t<decltype(std::declval<T&>().roll(
+			       size_t{}, size_t{}))>> : std::true_type {};
+
+}  // namespace detail
+
 template <typename T>
 class Subclass_policy : public Base, private T {
        public:
 	using base_t = Base;
 	explicit Subclass_policy(const T& t) : T(t) {}
 	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
+	}
 	State roll() override {
 		return T::roll();
 	}
+	State roll(size_t index, size_t count) override {
+		return roll(index, count, detail::has_indexed_roll<T>{});
+	}
+
+       private:
+	State roll(size_t index, size_t count, std::true_type) {
+		return T::roll(index, count);
+	}
+	State roll(size_t, size_t, std::false_type) { return T::roll(); }
 };
 
 template <typename T>
@@ -78,6 +111,46 @@ class Polarized3D {
 	}
 };
 
+// k from a spherical Fibonacci lattice of count points, randomly rotated
+// once per object, and a fixed spin
+//
+// roll() without an index draws k uniformly.
+class Fibonacci3D {
+       private:
+	arma::vec3 spin;
+	arma::mat33 rotation;
+
+       public:
+	Fibonacci3D(const arma::vec3& spin);
+	State roll();
+	State roll(size_t index, size_t count);
+
+	static constexpr const auto& name = "Fibonacci3D";
+	static constexpr const auto& keywords = make_array<const char*>("spin");
+	static auto factory(const arma::vec3& spin) {
+		return Fibonacci3D(spin);
+	}
+};
+
+// k from the first two dimensions of the Sobol sequence with a random
+// digital shift, mapped area-preserving to the sphere, and a fixed spin
+//
+// roll() without an index draws k uniformly.
+class Sobol3D {
+       private:
+	arma::vec3 spin;
+	std::uint32_t shift[2];
+
+       public:
+	Sobol3D(const arma::vec3& spin);
+	State roll();
+	State roll(size_t index, size_t count);
+
+	static constexpr const auto& name = "Sobol3D";
+	static constexpr const auto& keywords = make_array<const char*>("spin");
+	static auto factory(const arma::vec3& spin) { return Sobol3D(spin); }
+};
+
 }  // namespace InitialCondition
 
 namespace YAML {
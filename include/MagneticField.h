@@ -1,17 +1,33 @@
 #ifndef MAGNETIC_FIELD_H
 #define MAGNETIC_FIELD_H
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <yaml-cpp/yaml.h>
 #include <armadillo>
 
+#include "Misc.h"
 #include "RegisterSubclass.h"
+#include "Rotation.h"
 
 namespace MagneticField {
 
+// Part of the time axis on which the field is constant: starting from the
+// queried time until end the spin precesses with sign * (bconst + field).
+struct Interval {
+	double end;
+	double sign;
+	arma::vec3 field;
+
+	arma::vec3 precession(const arma::vec3& bconst) const {
+		return sign * (bconst + field);
+	}
+};
+
 class Base {
        public:
 	class Factory {
@@ -31,22 +47,42 @@ class Base {
 
        public:
 	static const auto& get_factories() { return factories(); }
-	virtual const arma::vec3 advance(const arma::vec3& s0, double t0,
-					 double t,
-					 const arma::vec3& bconst) = 0;
+	const arma::vec3 advance(const arma::vec3& s0, double t0, double t,
+				 const arma::vec3& bconst) const;
+	virtual Interval interval(double t) const = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
 	virtual ~Base() {}
 };
 
+// Propagates s0 from t0 to t under the SOC precession bconst, with one
+// rotation per interval of constant field
+template <typename real>
+Rotation::vec3<real> advance(const Base& magnetic_field,
+			     const Rotation::vec3<real>& s0, double t0,
+			     double t, const arma::vec3& bconst) {
+	auto s = s0;
+	while (t0 < t) {
+		const auto field = magnetic_field.interval(t0);
+		const auto t_end = std::min(field.end, t);
+		s = Misc::Rotate(s, Rotation::cast<real>(field.precession(bconst) *
+							 (t_end - t0)));
+		t0 = t_end;
+	}
+	return s;
+}
+
 template <typename T>
 class Subclass_policy : public Base, private T {
        public:
 	using base_t = Base;
 	explicit Subclass_policy(const T& t) : T(t) {}
 	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
-	const arma::vec3 advance(const arma::vec3& s0, double t0, double t,
-				 const arma::vec3& bconst) override {
-		return T::advance(s0, t0, t, bconst);
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
 	}
+	Interval interval(double t) const override { return T::interval(t); }
 };
 
 template <typename T>
@@ -54,8 +90,7 @@ using Subclass = PolyphormicSubclass<T, Subclass_policy>;
 
 class Zero {
        public:
-	const arma::vec3 advance(const arma::vec3& s0, double t0, double t,
-				 const arma::vec3& bconst);
+	Interval interval(double t) const;
 
 	static constexpr const auto& name = "Zero";
 	static constexpr const auto& keywords = make_array<const char*>();
@@ -70,8 +105,7 @@ class Step {
        public:
 	Step(const arma::vec3& field, double tstep)
 	    : field(field), tstep(tstep) {}
-	const arma::vec3 advance(const arma::vec3& s0, double t0, double t,
-				 const arma::vec3& bconst);
+	Interval interval(double t) const;
 
 	static constexpr const auto& name = "Step";
 	static constexpr const auto& keywords =
@@ -87,8 +121,7 @@ class Echo {
 
        public:
 	Echo(double tflip) : tflip(tflip) {}
-	const arma::vec3 advance(const arma::vec3& s0, double t0, double t,
-				 const arma::vec3& bconst);
+	Interval interval(double t) const;
 
 	static constexpr const auto& name = "Echo";
 	static constexpr const auto& keywords =
@@ -96,6 +129,36 @@ class Echo {
 	static auto factory(double tflip) { return Echo(tflip); }
 };
 
+// Sequence of pulses at given times
+//
+// Each event can flip the sign of the precession (an ideal pi pulse, as in
+// Echo) and/or set the external field (as in Step). Before the first event
+// the sign is positive and the field is zero. Events must be sorted by time.
+class PulseSequence {
+       public:
+	struct Event {
+		double t;
+		bool flip;
+		bool set_field;
+		arma::vec3 field;
+	};
+
+       private:
+	std::vector<double> times;       // event times
+	std::vector<Interval> intervals;  // before, between and after events
+
+       public:
+	PulseSequence(const std::vector<Event>& events);
+	Interval interval(double t) const;
+
+	static constexpr const auto& name = "PulseSequence";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("events");
+	static auto factory(const std::vector<Event>& events) {
+		return PulseSequence(events);
+	}
+};
+
 }  // namespace MagneticField
 
 namespace YAML {
@@ -103,6 +166,31 @@ namespace YAML {
 template <>
 std::unique_ptr<MagneticField::Base> Node::as() const;
 
+template <>
+struct convert<MagneticField::PulseSequence::Event> {
+	static Node encode(const MagneticField::PulseSequence::Event& rhs) {
+		Node node;
+		node["t"] = rhs.t;
+		node["flip"] = rhs.flip;
+		if (rhs.set_field) {
+			node["field"] = rhs.field;
+		}
+		return node;
+	}
+
+	static bool decode(const Node& node,
+			   MagneticField::PulseSequence::Event& rhs) {
+		rhs.t = Misc::mapat(node, "t").as<double>();
+		rhs.flip = node["flip"] ? Misc::mapat(node, "flip").as<bool>()
+					: false;
+		rhs.set_field = static_cast<bool>(node["field"]);
+		rhs.field = rhs.set_field
+				? Misc::mapat(node, "field").as<arma::vec3>()
+				: arma::vec3(arma::fill::zeros);
+		return true;
+	}
+};
+
 }  // namespace YAML
 
 #endif  // MAGNETIC_FIELD_H
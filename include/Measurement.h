@@ -3,20 +3,73 @@
 
 #include <map>
 #include <memory>
+#include <ostream>
 #include <string>
+#include <vector>
 
 #include <yaml-cpp/yaml.h>
 #include <armadillo>
 
 #include "InitialCondition.h"
 #include "MagneticField.h"
+#include "Observable.h"
 #include "RegisterSubclass.h"
 #include "SOCModel.h"
 #include "ScatteringModel.h"
 #include "Output.h"
+#include "PerfCounters.h"
+#include "Threads.h"
+#include "TimeGrid.h"
 
 namespace Measurement {
 
+// Expected cost of a run on the current machine, see Base::estimate
+struct Estimate {
+	// Scattering events of all the spins
+	double events;
+	// Trajectories distributed over the threads, and their calibrated
+	// time on one thread
+	size_t trajectories;
+	double trajectory_seconds;
+	// Threads of the run, false if it is sequential
+	unsigned int threads;
+	bool parallel;
+	// Whether every trajectory is split in time over the threads instead,
+	// and the part of trajectory_seconds which stays on one thread then
+	bool split_in_time;
+	double serial_seconds;
+	// Bytes independent of the thread count, per thread and per
+	// trajectory assigned to a thread
+	size_t shared_memory;
+	size_t thread_memory;
+	size_t trajectory_memory;
+};
+
+// Prints the events, and the memory per thread and the wall time for thread
+// counts up to the hardware concurrency. The synchronisation of the threads
+// of a run split in time is not counted.
+void print(std::ostream& out, const Estimate& estimate);
+
+// What a run reports besides its records, see Base::run
+struct Report {
+	// Placement of every worker thread at its start and at its end
+	struct Worker {
+		Threads::Placement start;
+		Threads::Placement end;
+	};
+	std::vector<Worker> workers;
+	// Variance of the mean of independent pairs over the one of antithetic
+	// pairs, 0 without antithetic pairs
+	double variance_reduction = 0.;
+	// Comment lines of ScatteringModel::Base::print_statistics
+	std::string scattering_statistics;
+	// Counts of all threads of the run
+	PerfCounters::Totals perf;
+};
+
+// Prints the report as comment lines
+void print(std::ostream& out, const Report& report);
+
 class Base {
        public:
 	class Factory {
@@ -36,7 +89,13 @@ class Base {
 
        public:
 	static const auto& get_factories() { return factories(); }
-	virtual void run() = 0;
+	// Writes the records to the output
+	virtual Report run() = 0;
+	// Times the kernels of run on a few shortened trajectories, without
+	// running the measurement
+	virtual Estimate estimate() = 0;
+	// Replaces the output given in YAML, which may be null
+	virtual void set_output(std::unique_ptr<Output::Base>&& output) = 0;
 		virtual ~Base() {}
 };
 
@@ -46,8 +105,14 @@ class Subclass_policy : public Base, private T {
 	using base_t = Base;
 	explicit Subclass_policy(const T& t) : T(t) {}
 	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
-	void run() override {
-		T::run();
+	Report run() override {
+		return T::run();
+	}
+	Estimate estimate() override {
+		return T::estimate();
+	}
+	void set_output(std::unique_ptr<Output::Base>&& output) override {
+		T::set_output(std::move(output));
 	}
 };
 
@@ -58,55 +123,119 @@ class Ensamble {
        private:
 	unsigned int spin_count;
 	double duration;
-	double time_step;
+	TimeGrid::Grid grid;
 	double t0;
+	// Samples per window, 0 processes the whole duration at once
+	unsigned int window;
+	// Propagate every trajectory together with its k -> -k mirror image
+	bool antithetic;
 	unsigned int threads;
+	Threads::Pin pin;
+	// Split every trajectory in time over the threads instead of
+	// distributing the trajectories, see Trajectory::TimeSplit
+	bool parallel_in_time;
+	bool single_precision;
+	bool fast_math;
 	std::unique_ptr<InitialCondition::Base> initial_condition;
 	std::unique_ptr<ScatteringModel::Base> scattering_model;
 	std::unique_ptr<MagneticField::Base> magnetic_field;
 	std::unique_ptr<SOCModel::Base> soc_model;
+	std::vector<std::unique_ptr<Observable::Base>> observables;
 	std::unique_ptr<Output::Base> output;
-	arma::mat do_run(unsigned int thread_nr);
+	// Spin trajectories are propagated in real precision, the observables
+	// are accumulated in double.
+	template <typename real>
+	Report do_run();
+	template <typename real>
+	Report do_run_in_time();
+	template <typename real>
+	Estimate do_estimate();
 
        public:
-	Ensamble(unsigned int spin_count, double duration, double time_step, double t0, unsigned int threads,
+	Ensamble(unsigned int spin_count, double duration, double time_step, std::unique_ptr<TimeGrid::Base>&& time_grid, double t0, unsigned int window, bool antithetic, Threads::Count threads,
+		 Threads::Pin pin, bool parallel_in_time,
+		 const std::string& precision, bool fast_math,
 		 std::unique_ptr<InitialCondition::Base>&& initial_condition,
 		 std::unique_ptr<ScatteringModel::Base>&& scattering_model,
 		 std::unique_ptr<MagneticField::Base>&& magnetic_field,
 		 std::unique_ptr<SOCModel::Base>&& soc_model,
+		 std::vector<std::unique_ptr<Observable::Base>>&& observables,
 		 std::unique_ptr<Output::Base>&& output);
 
-	void run();
+	Report run();
+	Estimate estimate();
+	void set_output(std::unique_ptr<Output::Base>&& output) {
+		this->output = std::move(output);
+	}
 
 	static constexpr const auto &name = "Ensamble";
 	static constexpr const auto &keywords = make_array<const char*>(
 		"spin_count",
 		"duration",
 		"time_step",
+		"time_grid",
 		"t0",
+		"window",
+		"antithetic",
 		"threads",
+		"pin",
+		"parallel_in_time",
+		"precision",
+		"fast_math",
 		"initial_condition",
 		"scattering_model",
 		"magnetic_field",
 		"soc_model",
+		"observables",
 		"output"
 		);
-	static auto factory(unsigned int spin_count, double duration, double time_step, double t0, unsigned int threads,
+	static constexpr const auto &defaults = make_array<const char*>(
+		nullptr,
+		nullptr,
+		"0",
+		"~",
+		nullptr,
+		"0",
+		"false",
+		"auto",
+		"none",
+		"false",
+		"double",
+		"false",
+		nullptr,
+		nullptr,
+		nullptr,
+		nullptr,
+		"[{type: Spin}]",
+		"~"
+		);
+	static auto factory(unsigned int spin_count, double duration, double time_step, std::unique_ptr<TimeGrid::Base>&& time_grid, double t0, unsigned int window, bool antithetic, Threads::Count threads,
+		 Threads::Pin pin, bool parallel_in_time,
+		 const std::string& precision, bool fast_math,
 		 std::unique_ptr<InitialCondition::Base>&& initial_condition,
 		 std::unique_ptr<ScatteringModel::Base>&& scattering_model,
 		 std::unique_ptr<MagneticField::Base>&& magnetic_field,
 		 std::unique_ptr<SOCModel::Base>&& soc_model,
+		 std::vector<std::unique_ptr<Observable::Base>>&& observables,
 		 std::unique_ptr<Output::Base>&& output){
 		return Ensamble(
 		    spin_count,
 		    duration,
 		    time_step,
+		    std::move(time_grid),
 		    t0,
+		    window,
+		    antithetic,
 		    threads,
+		    pin,
+		    parallel_in_time,
+		    precision,
+		    fast_math,
 		    std::move(initial_condition),
 		    std::move(scattering_model),
 		    std::move(magnetic_field),
 		    std::move(soc_model),
+		    std::move(observables),
 		    std::move(output)
 		    );
 	}
@@ -116,8 +245,11 @@ class EchoDecay {
        private:
 	unsigned int spin_count;
 	double duration;
-	double time_step;
+	TimeGrid::Grid grid;
 	double t0;
+	// More than one splits every trajectory in time, see
+	// Trajectory::TimeSplit
+	unsigned int threads;
 	std::unique_ptr<InitialCondition::Base> initial_condition;
 	std::unique_ptr<ScatteringModel::Base> scattering_model;
 	std::unique_ptr<SOCModel::Base> soc_model;
@@ -125,27 +257,46 @@ class EchoDecay {
 
        public:
 	EchoDecay(unsigned int spin_count, double duration, double time_step,
-		  double t0,
+		  std::unique_ptr<TimeGrid::Base>&& time_grid,
+		  double t0, Threads::Count threads,
 		  std::unique_ptr<InitialCondition::Base>&& initial_condition,
 		  std::unique_ptr<ScatteringModel::Base>&& scattering_model,
 		  std::unique_ptr<SOCModel::Base>&& soc_model,
 		  std::unique_ptr<Output::Base>&& output);
 
-	void run();
-	void run(unsigned int threads);
+	Report run();
+	Report run(unsigned int threads);
+	Estimate estimate();
+	void set_output(std::unique_ptr<Output::Base>&& output) {
+		this->output = std::move(output);
+	}
 
 	static constexpr const auto &name = "EchoDecay";
 	static constexpr const auto &keywords = make_array<const char*>(
 		"spin_count",
 		"duration",
 		"time_step",
+		"time_grid",
 		"t0",
+		"threads",
 		"initial_condition",
 		"scattering_model",
 		"soc_model",
 		"output"
 		);
-	static auto factory(unsigned int spin_count, double duration, double time_step, double t0,
+	static constexpr const auto &defaults = make_array<const char*>(
+		nullptr,
+		nullptr,
+		"0",
+		"~",
+		nullptr,
+		"1",
+		nullptr,
+		nullptr,
+		nullptr,
+		"~"
+		);
+	static auto factory(unsigned int spin_count, double duration, double time_step, std::unique_ptr<TimeGrid::Base>&& time_grid, double t0, Threads::Count threads,
 		 std::unique_ptr<InitialCondition::Base>&& initial_condition,
 		 std::unique_ptr<ScatteringModel::Base>&& scattering_model,
 		 std::unique_ptr<SOCModel::Base>&& soc_model,
@@ -154,7 +305,9 @@ class EchoDecay {
 		    spin_count,
 		    duration,
 		    time_step,
+		    std::move(time_grid),
 		    t0,
+		    threads,
 		    std::move(initial_condition),
 		    std::move(scattering_model),
 		    std::move(soc_model),
@@ -167,7 +320,7 @@ class EchoDecayTest {
        private:
 	unsigned int spin_count;
 	double duration;
-	double time_step;
+	TimeGrid::Grid grid;
 	double t0;
 	std::unique_ptr<InitialCondition::Base> initial_condition;
 	std::unique_ptr<ScatteringModel::Base> scattering_model;
@@ -176,27 +329,44 @@ class EchoDecayTest {
 
        public:
 	EchoDecayTest(unsigned int spin_count, double duration, double time_step,
+		  std::unique_ptr<TimeGrid::Base>&& time_grid,
 		  double t0,
 		  std::unique_ptr<InitialCondition::Base>&& initial_condition,
 		  std::unique_ptr<ScatteringModel::Base>&& scattering_model,
 		  std::unique_ptr<SOCModel::Base>&& soc_model,
 		  std::unique_ptr<Output::Base>&& output);
 
-	void run();
-	void run(unsigned int threads);
+	Report run();
+	Report run(unsigned int threads);
+	Estimate estimate();
+	void set_output(std::unique_ptr<Output::Base>&& output) {
+		this->output = std::move(output);
+	}
 
 	static constexpr const auto &name = "EchoDecayTest";
 	static constexpr const auto &keywords = make_array<const char*>(
 		"spin_count",
 		"duration",
 		"time_step",
+		"time_grid",
 		"t0",
 		"initial_condition",
 		"scattering_model",
 		"soc_model",
 		"output"
 		);
-	static auto factory(unsigned int spin_count, double duration, double time_step, double t0,
+	static constexpr const auto &defaults = make_array<const char*>(
+		nullptr,
+		nullptr,
+		"0",
+		"~",
+		nullptr,
+		nullptr,
+		nullptr,
+		nullptr,
+		"~"
+		);
+	static auto factory(unsigned int spin_count, double duration, double time_step, std::unique_ptr<TimeGrid::Base>&& time_grid, double t0,
 		 std::unique_ptr<InitialCondition::Base>&& initial_condition,
 		 std::unique_ptr<ScatteringModel::Base>&& scattering_model,
 		 std::unique_ptr<SOCModel::Base>&& soc_model,
@@ -205,6 +375,7 @@ class EchoDecayTest {
 		    spin_count,
 		    duration,
 		    time_step,
+		    std::move(time_grid),
 		    t0,
 		    std::move(initial_condition),
 		    std::move(scattering_model),
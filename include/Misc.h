@@ -14,6 +14,7 @@ namespace arma_types {
 
 namespace Misc {
 arma::vec3 Rotate(const arma::vec3& v0, const arma::vec3& phi);
+arma::fvec3 Rotate(const arma::fvec3& v0, const arma::fvec3& phi);
 
 template<typename... Ts> struct make_void { typedef void type;};
 template<typename... Ts> using void_t = typename make_void<Ts...>::type;
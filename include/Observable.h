@@ -0,0 +1,193 @@
+#ifndef OBSERVABLE_H
+#define OBSERVABLE_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+#include <armadillo>
+
+#include "RegisterSubclass.h"
+
+namespace Observable {
+
+// State of one spin at one sample time
+struct Sample {
+	double t;
+	const arma::vec3& spin;
+	const arma::vec3& k;
+	const arma::vec3& initial_spin;
+};
+
+class Base {
+       public:
+	class Factory {
+	       public:
+		virtual std::unique_ptr<Base> create_from_YAML(
+		    const YAML::Node&) = 0;
+		virtual ~Factory() {}
+	};
+
+       private:
+	static auto& factories() {
+		static std::map<std::string, std::unique_ptr<Factory>> f;
+		return f;
+	};
+	template <typename Base, typename Child>
+	friend RegisterSubclass<Base, Child>::Register::Register();
+
+       public:
+	static const auto& get_factories() { return factories(); }
+	// Names of the output columns
+	virtual std::vector<std::string> columns() const = 0;
+	// Adds the contribution of one sample to acc[0 .. columns().size())
+	virtual void accumulate(double* acc, const Sample& sample) const = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
+	virtual ~Base() {}
+};
+
+template <typename T>
+class Subclass_policy : public Base, private T {
+       public:
+	using base_t = Base;
+	explicit Subclass_policy(const T& t) : T(t) {}
+	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
+	}
+	std::vector<std::string> columns() const override {
+		return T::columns();
+	}
+	void accumulate(double* acc, const Sample& sample) const override {
+		T::accumulate(acc, sample);
+	}
+};
+
+template <typename T>
+using Subclass = PolyphormicSubclass<T, Subclass_policy>;
+
+// Sums of one observable over the spins of one thread, one column per
+// sample time
+class Accumulator {
+       private:
+	const Base* observable;
+	arma::mat sums;
+
+       public:
+	Accumulator(const Base& observable, size_t size)
+	    : observable(&observable),
+	      sums(observable.columns().size(), size, arma::fill::zeros) {}
+	void add(size_t i, const Sample& sample) {
+		observable->accumulate(sums.colptr(i), sample);
+	}
+	void merge(const Accumulator& other) { sums += other.sums; }
+	const arma::mat& values() const { return sums; }
+};
+
+// <s>
+class Spin {
+       public:
+	std::vector<std::string> columns() const;
+	void accumulate(double* acc, const Sample& sample) const;
+
+	static constexpr const auto& name = "Spin";
+	static constexpr const auto& keywords = make_array<const char*>();
+	static auto factory() { return Spin{}; }
+};
+
+// <s . s0>
+class Projection {
+       public:
+	std::vector<std::string> columns() const;
+	void accumulate(double* acc, const Sample& sample) const;
+
+	static constexpr const auto& name = "Projection";
+	static constexpr const auto& keywords = make_array<const char*>();
+	static auto factory() { return Projection{}; }
+};
+
+// <|s_perp|>, length of the spin component perpendicular to axis
+class Transverse {
+       private:
+	arma::vec3 axis;
+
+       public:
+	Transverse(const arma::vec3& axis);
+	std::vector<std::string> columns() const;
+	void accumulate(double* acc, const Sample& sample) const;
+
+	static constexpr const auto& name = "Transverse";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("axis");
+	static constexpr const auto& defaults =
+	    make_array<const char*>("[0., 0., 1.]");
+	static auto factory(const arma::vec3& axis) {
+		return Transverse(axis);
+	}
+};
+
+// <s_i k_j>
+class SpinK {
+       public:
+	std::vector<std::string> columns() const;
+	void accumulate(double* acc, const Sample& sample) const;
+
+	static constexpr const auto& name = "SpinK";
+	static constexpr const auto& keywords = make_array<const char*>();
+	static auto factory() { return SpinK{}; }
+};
+
+// <s_i^order>
+class Moment {
+       private:
+	unsigned int order;
+
+       public:
+	Moment(unsigned int order);
+	std::vector<std::string> columns() const;
+	void accumulate(double* acc, const Sample& sample) const;
+
+	static constexpr const auto& name = "Moment";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("order");
+	static auto factory(unsigned int order) { return Moment(order); }
+};
+
+// Distribution of quantity over bins of equal width, one column per bin
+//
+// quantity is one of s_x, s_y, s_z, binned over [-1, 1], or angle, the angle
+// between the spin and the initial spin binned over [0, pi].
+class Histogram {
+       private:
+	int component;  // 0..2 for s_x..s_z, -1 for angle
+	unsigned int bins;
+	double min;
+	double width;
+
+       public:
+	Histogram(const std::string& quantity, unsigned int bins);
+	std::vector<std::string> columns() const;
+	void accumulate(double* acc, const Sample& sample) const;
+
+	static constexpr const auto& name = "Histogram";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("quantity", "bins");
+	static auto factory(const std::string& quantity, unsigned int bins) {
+		return Histogram(quantity, bins);
+	}
+};
+
+}  // namespace Observable
+
+namespace YAML {
+
+template <>
+std::unique_ptr<Observable::Base> Node::as() const;
+
+}  // namespace YAML
+
+#endif  // OBSERVABLE_H
@@ -8,6 +8,7 @@
 #include <vector>
 
 #include <yaml-cpp/yaml.h>
+#include <armadillo>
 
 #include "RegisterSubclass.h"
 
@@ -54,11 +55,16 @@ class Subclass_policy : public Base, private T {
 template <typename T>
 using Subclass = PolyphormicSubclass<T, Subclass_policy>;
 
+// The file is created by the first write, constructing the output alone
+// leaves an existing file untouched.
 class CSVFile {
        private:
+	std::string path;
 	std::unique_ptr<std::ostream> out;
 	bool header;
 
+	std::ostream& stream();
+
        public:
 	CSVFile(const std::string& path, bool header);
 	void write_header(const std::vector<std::string>&);
@@ -72,10 +78,29 @@ class CSVFile {
 	}
 };
 
+// Keeps the records in memory, for the library API
+//
+// Not available from YAML.
+class Memory : public Base {
+       private:
+	std::vector<std::string> header;
+	std::vector<double> records;  // row by row
+	size_t columns = 0;
+
+       public:
+	void write_header(const std::vector<std::string>& h) override;
+	void write_record(const std::vector<double>& r) override;
+
+	const std::vector<std::string>& get_header() const { return header; }
+	// One row per record
+	arma::mat values() const;
+};
+
 }  // namespace Output
 
 namespace YAML {
 
+// Null gives nullptr
 template <>
 std::unique_ptr<Output::Base> Node::as() const;
 
@@ -0,0 +1,86 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Hardware performance counters per thread and phase of a run
+//
+// While enabled() is set, every thread entering a Scope opens counters of
+// its own for cycles, instructions, cache misses and branch misses with
+// perf_event_open, user space only. The increments of the counters are
+// attributed to the phase of the innermost Scope, the counters are read once
+// per change of the phase, with rdpmc where the kernel allows it and with
+// read() otherwise. The counts are not scaled if the kernel multiplexes the
+// counters.
+//
+// Counters that cannot be opened, for lack of permission
+// (kernel.perf_event_paranoid > 2) or without a PMU as in many virtual
+// machines, are reported as n/a and the run is not affected. While disabled
+// a Scope costs one relaxed atomic load.
+
+namespace PerfCounters {
+
+enum class Phase { other, generation, propagation, sampling, output };
+constexpr size_t phase_count = 5;
+
+// cycles, instructions, cache misses, branch misses
+constexpr size_t event_count = 4;
+
+// Counts of one or more threads
+struct Totals {
+	// counts[phase][event]
+	std::array<std::array<std::uint64_t, event_count>, phase_count>
+	    counts{};
+	// Threads that opened counters, once for every take, and for every
+	// event the ones for which it succeeded
+	unsigned int threads = 0;
+	std::array<unsigned int, event_count> opened{};
+	// errno of the first counter that could not be opened
+	int error = 0;
+
+	Totals& operator+=(const Totals& other);
+};
+
+// Off by default, DP_random_walk sets it with --perf-counters
+std::atomic<bool>& enabled();
+
+namespace detail {
+Phase enter(Phase phase);
+}  // namespace detail
+
+// Counts the calling thread in phase until the end of the scope
+class Scope {
+       private:
+	bool active;
+	Phase previous = Phase::other;
+
+       public:
+	explicit Scope(Phase phase)
+	    : active(enabled().load(std::memory_order_relaxed)) {
+		if (active) {
+			previous = detail::enter(phase);
+		}
+	}
+	~Scope() {
+		if (active) {
+			detail::enter(previous);
+		}
+	}
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+};
+
+// Counts of the calling thread since the last call, which starts over
+Totals take();
+
+// Comment lines with the counts per phase, nothing if no thread opened
+// counters
+void print(std::ostream& out, const Totals& totals);
+
+}  // namespace PerfCounters
+
+#endif  // PERF_COUNTERS_H
@@ -1,11 +1,109 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
-#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
-using random_engine = std::mt19937;
+#include <armadillo>
 
+// xoshiro256++ running several independent lanes, the lanes are 2^128 steps
+// apart in the sequence. Raw words are generated a block at a time, with the
+// lanes stepped together so the compiler can vectorise the refill, and
+// handed out one by one.
+//
+// https://prng.di.unimi.it/
+class Xoshiro256pp {
+       public:
+	using result_type = std::uint64_t;
+	static constexpr size_t lanes = 4;
+	static constexpr size_t block_size = 256;
+	static constexpr result_type default_seed = 5489u;
+
+	explicit Xoshiro256pp(result_type seed = default_seed) {
+		this->seed(seed);
+	}
+	void seed(result_type seed);
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~result_type(0); }
+	result_type operator()() {
+		if (pos == block_size) {
+			refill();
+		}
+		return block[pos++];
+	}
+
+       private:
+	void refill();
+
+	result_type state[4][lanes];
+	result_type block[block_size];
+	size_t pos;
+};
+
+using random_engine = Xoshiro256pp;
+
+// Engine of the calling thread, seed is only used on the first call in
+// each thread.
 random_engine& get_random_engine(
     random_engine::result_type seed = random_engine::default_seed);
 
+namespace Random {
+
+// Uniform in [0, 1), 53 random bits
+inline double uniform(random_engine& engine) {
+	return (engine() >> 11) * (1. / 9007199254740992.);
+}
+
+inline double exponential(random_engine& engine, double rate) {
+	return -std::log(1. - uniform(engine)) / rate;
+}
+
+// Standard normal, Marsaglia's polar method
+inline double normal(random_engine& engine) {
+	double u, v, s;
+	do {
+		u = 2. * uniform(engine) - 1.;
+		v = 2. * uniform(engine) - 1.;
+		s = u * u + v * v;
+	} while (s >= 1. || s == 0.);
+	return u * std::sqrt(-2. * std::log(s) / s);
+}
+
+// Uniform on the unit sphere, Marsaglia's method
+inline arma::vec3 unit_vector(random_engine& engine) {
+	double u, v, s;
+	do {
+		u = 2. * uniform(engine) - 1.;
+		v = 2. * uniform(engine) - 1.;
+		s = u * u + v * v;
+	} while (s >= 1.);
+	const auto r = 2. * std::sqrt(1. - s);
+	return arma::vec3{u * r, v * r, 1. - 2. * s};
+}
+
+// Walker's alias method, with Vose's construction of the table
+//
+// Draws index i with probability proportional to weights[i] in O(1), from
+// one uniform number.
+class AliasTable {
+       private:
+	std::vector<double> probability;
+	std::vector<std::uint32_t> alias;
+
+       public:
+	explicit AliasTable(const std::vector<double>& weights);
+
+	size_t operator()(random_engine& engine) const {
+		const auto u = uniform(engine) * probability.size();
+		const auto i = std::min((size_t)u, probability.size() - 1);
+		return u - i < probability[i] ? i : alias[i];
+	}
+};
+
+}  // namespace Random
+
 #endif  // RANDOM_H
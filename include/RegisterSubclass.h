@@ -43,6 +43,22 @@ struct reflection_traits {
 	static constexpr auto& factory = T::factory;
 };
 
+// Optional keywords
+//
+// A class can declare a static array "defaults" parallel to "keywords". A
+// non-null entry is the YAML text used when the keyword is missing from the
+// node, null entries mark required keywords.
+template <typename T, typename = void>
+struct keyword_defaults {
+	static const char* get(size_t) { return nullptr; }
+};
+
+template <typename T>
+struct keyword_defaults<T, Misc::void_t<decltype(T::defaults)>> {
+	static_assert(arraysize(T::defaults) == arraysize(T::keywords), "");
+	static const char* get(size_t i) { return T::defaults[i]; }
+};
+
 template <typename T, template <typename> class Policy>
 class PolyphormicSubclass : public Policy<T> {
        private:
@@ -68,8 +84,15 @@ class PolyphormicSubclass : public Policy<T> {
 
 			auto arg_array = array_type();
 			for (size_t i = 0; i < arg_size; ++i) {
-				arg_array[i] =
-				    Misc::mapat(node, trait_t::keywords[i]);
+				const auto default_value =
+				    keyword_defaults<T>::get(i);
+				if (default_value && node.IsMap() &&
+				    !node[trait_t::keywords[i]]) {
+					arg_array[i] = YAML::Load(default_value);
+				} else {
+					arg_array[i] = Misc::mapat(
+					    node, trait_t::keywords[i]);
+				}
 			}
 
 			return std::make_unique<PolyphormicSubclass>(
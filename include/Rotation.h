@@ -9,7 +9,8 @@ namespace Rotation {
 // Concept Rotation (rot)
 //
 // A Concept of types representing 3D rotation vector operations.
-// Possible implementations can use 3x3 matrices or quaternions.
+// Possible implementations can use 3x3 matrices or quaternions, in single or
+// double precision. vec3 is the 3 element column of the same scalar type.
 //
 // Member functions:
 //
@@ -20,75 +21,201 @@ namespace Rotation {
 // operator=(const rot&)
 // operator=(rot&&)
 //
-// rot(double angle, const arma::vec3& direction) // assumes normalized direction
-// rot(const arma::vec3& rotvec) // angle * direction
+// rot(real angle, const vec3& direction) // assumes normalized direction
+// rot(const vec3& rotvec) // angle * direction
 //
 // rot operator* (const rot& rhs) const // composition
-// arma::vec3 operator* (const arma::vec3& v) const // apply to vector
+// vec3 operator* (const vec3& v) const // apply to vector
 // rot inverse()
 //
 // Static members:
 // rot identity()
 
-class matrix_rotation {
+template <typename real>
+using vec3 = typename arma::Col<real>::template fixed<3>;
+
+template <typename real>
+vec3<real> cast(const arma::vec3& v) {
+	return vec3<real>{real(v[0]), real(v[1]), real(v[2])};
+}
+
+// Coefficients of Rodrigues' formula for a rotation vector phi of angle
+// theta = |phi|, without normalising phi
+//
+//   R v = cos v + sinc (phi x v) + cosc (phi . v) phi
+//
+// with sinc = sin(theta) / theta and cosc = (1 - cos(theta)) / theta^2. They
+// are even in theta and computed from theta2 = phi . phi.
+//
+// Below small_angle<real>::theta2 the Taylor series
+//   sinc = 1 - t/6 + t^2/120 - t^3/5040
+//   cosc = 1/2 - t/24 + t^2/720 - t^3/40320
+// is used. It alternates with decreasing terms, so the truncation errors are
+// below t^4/362880 and t^4/3628800, i.e. under half an ulp at the threshold
+// (4.0e-17 for double at t = 1/512, 1.1e-8 for float at t = 1/4). Above it
+// one sin and one cos of theta/2 are evaluated, which avoids the cancellation
+// in 1 - cos(theta).
+//
+// In fast_math mode no trigonometric function is called: the series is
+// evaluated at theta / 2^n below the threshold and doubled n times with
+//   sinc(2x) = sinc(x) (1 - x^2 cosc(x)),  cosc(2x) = sinc(x)^2 / 2.
+// Every doubling at most doubles the error, so it grows linearly with the
+// angle, to about 4 eps theta / sqrt(small_angle<real>::theta2).
+template <typename real>
+struct Rodrigues {
+	real cos;
+	real sinc;
+	real cosc;
+};
+
+template <typename real>
+struct small_angle;
+
+template <>
+struct small_angle<double> {
+	static constexpr double theta2 = 1. / 512.;
+};
+
+template <>
+struct small_angle<float> {
+	static constexpr float theta2 = 1.f / 4.f;
+};
+
+// Selects the fast_math kernel for the calling thread
+inline bool& fast_math() {
+	thread_local bool enabled = false;
+	return enabled;
+}
+
+template <typename real>
+inline Rodrigues<real> rodrigues(real theta2) {
+	const real threshold = small_angle<real>::theta2;
+	auto t = theta2;
+	unsigned int doublings = 0;
+	if (t >= threshold) {
+		if (!fast_math()) {
+			const auto half = std::sqrt(t) / real(2.);
+			const auto s = std::sin(half);
+			const auto c = std::cos(half);
+			const auto sinc = s * c / half;
+			const auto cosc = s * s / (real(2.) * half * half);
+			return Rodrigues<real>{real(1.) - real(2.) * s * s, sinc,
+					       cosc};
+		}
+		while (t >= threshold) {
+			t /= real(4.);
+			++doublings;
+		}
+	}
+
+	auto sinc = real(1.) - t / real(6.) *
+				   (real(1.) - t / real(20.) *
+						   (real(1.) - t / real(42.)));
+	auto cosc =
+	    real(.5) * (real(1.) - t / real(12.) *
+				       (real(1.) - t / real(30.) *
+						       (real(1.) - t / real(56.))));
+	for (; doublings > 0; --doublings) {
+		const auto doubled = sinc * (real(1.) - t * cosc);
+		cosc = real(.5) * sinc * sinc;
+		sinc = doubled;
+		t *= real(4.);
+	}
+	return Rodrigues<real>{real(1.) - theta2 * cosc, sinc, cosc};
+}
+
+template <typename real>
+class basic_matrix_rotation {
+       public:
+	using vec_type = vec3<real>;
+	using mat_type = typename arma::Mat<real>::template fixed<3, 3>;
+
        private:
-	arma::mat33 rot_matrix;
+	mat_type rot_matrix;
 
-	explicit matrix_rotation(const arma::mat33& rot_matrix)
+	explicit basic_matrix_rotation(const mat_type& rot_matrix)
 	    : rot_matrix(rot_matrix) {}
-	explicit matrix_rotation(arma::mat33&& rot_matrix)
+	explicit basic_matrix_rotation(mat_type&& rot_matrix)
 	    : rot_matrix(std::move(rot_matrix)) {}
 
        public:
-	matrix_rotation() = default;  // Allow uninitialized creation, don't use
-				      // before copy-assign
-	matrix_rotation(double angle, const arma::vec3& direction);
-	matrix_rotation(const arma::vec3& rotvec);
-	static matrix_rotation identity();
+	basic_matrix_rotation() = default;  // Allow uninitialized creation,
+					    // don't use before copy-assign
+	basic_matrix_rotation(real angle, const vec_type& direction);
+	basic_matrix_rotation(const vec_type& rotvec);
+	static basic_matrix_rotation identity();
 
-	matrix_rotation operator*(const matrix_rotation& rhs) const;
-	arma::vec3 operator*(const arma::vec3&)const;
+	basic_matrix_rotation operator*(const basic_matrix_rotation& rhs) const;
+	vec_type operator*(const vec_type&)const;
 
-	matrix_rotation inverse() const;
+	basic_matrix_rotation inverse() const;
 };
 
-inline matrix_rotation::matrix_rotation(double angle,
-					const arma::vec3& direction)
-    : rot_matrix(arma::fill::eye) {
-	// Rodrigues' rotation formula
-	// https://en.wikipedia.org/wiki/Rodrigues%27_rotation_formula
-	const auto& k = direction;
-	arma::mat33 cross_matrix = {
+namespace detail {
+
+template <typename mat_type, typename vec_type>
+mat_type cross_matrix(const vec_type& k) {
+	return mat_type{
 	  {    0., -k[2],  k[1]},
 	  {  k[2],    0., -k[0]},
 	  { -k[1],  k[0],    0.}
 	};
+}
+
+}  // namespace detail
+
+template <typename real>
+inline basic_matrix_rotation<real>::basic_matrix_rotation(
+    real angle, const vec_type& direction)
+    : rot_matrix(arma::fill::eye) {
+	// Rodrigues' rotation formula
+	// https://en.wikipedia.org/wiki/Rodrigues%27_rotation_formula
+	const auto c = rodrigues(angle * angle);
+	const auto cross_matrix = detail::cross_matrix<mat_type>(direction);
 	rot_matrix += (
-	  std::sin(angle) * arma::mat33(arma::fill::eye)
-	  + (1. - std::cos(angle)) * cross_matrix
+	  angle * c.sinc * mat_type(arma::fill::eye)
+	  + angle * angle * c.cosc * cross_matrix
 	) * cross_matrix;
 }
 
-inline matrix_rotation::matrix_rotation(const arma::vec3& rotvec)
-    : matrix_rotation(arma::norm(rotvec), arma::normalise(rotvec)) {}
+template <typename real>
+inline basic_matrix_rotation<real>::basic_matrix_rotation(
+    const vec_type& rotvec)
+    : rot_matrix(arma::fill::eye) {
+	const auto c = rodrigues(real(arma::dot(rotvec, rotvec)));
+	const auto cross_matrix = detail::cross_matrix<mat_type>(rotvec);
+	rot_matrix += (
+	  c.sinc * mat_type(arma::fill::eye)
+	  + c.cosc * cross_matrix
+	) * cross_matrix;
+}
 
-inline matrix_rotation matrix_rotation::identity() {
-	return matrix_rotation(arma::mat33(arma::fill::eye));
+template <typename real>
+inline basic_matrix_rotation<real> basic_matrix_rotation<real>::identity() {
+	return basic_matrix_rotation(mat_type(arma::fill::eye));
 }
 
-inline matrix_rotation matrix_rotation::operator*(
-    const matrix_rotation& rhs) const {
-	return matrix_rotation(arma::mat33(this->rot_matrix * rhs.rot_matrix));
+template <typename real>
+inline basic_matrix_rotation<real> basic_matrix_rotation<real>::operator*(
+    const basic_matrix_rotation& rhs) const {
+	return basic_matrix_rotation(mat_type(this->rot_matrix * rhs.rot_matrix));
 }
 
-inline arma::vec3 matrix_rotation::operator*(const arma::vec3& v) const {
+template <typename real>
+inline typename basic_matrix_rotation<real>::vec_type
+basic_matrix_rotation<real>::operator*(const vec_type& v) const {
 	return this->rot_matrix * v;
 }
 
-inline matrix_rotation matrix_rotation::inverse() const {
-	return matrix_rotation(arma::mat33(this->rot_matrix.t()));
+template <typename real>
+inline basic_matrix_rotation<real> basic_matrix_rotation<real>::inverse()
+    const {
+	return basic_matrix_rotation(mat_type(this->rot_matrix.t()));
 }
 
+using matrix_rotation = basic_matrix_rotation<double>;
+using fmatrix_rotation = basic_matrix_rotation<float>;
+
 using rotation = matrix_rotation;
 
 }  // namespace Rotation
@@ -32,18 +32,74 @@ class Base {
        public:
 	static const auto& get_factories() { return factories(); }
 	virtual arma::vec3 omega(const arma::vec3& k) const = 0;
+	// Batched evaluation on a block of k vectors stored as the rows of k,
+	// i.e. one contiguous column per component. Row i of result is set to
+	// omega of row i of k.
+	virtual void omega(const arma::mat& k, arma::mat& result) const = 0;
+	// Affine decorators (omega = lambdas % base_model(k) + offset) give up
+	// their base model and fold their own map into lambdas and offset,
+	// other models return nullptr.
+	virtual std::unique_ptr<Base> release_base_model(arma::vec3& lambdas,
+							 arma::vec3& offset) = 0;
+	// Model evaluating lambdas % omega(k) + offset, consumes this model
+	virtual std::unique_ptr<Base> fuse(const arma::vec3& lambdas,
+					   const arma::vec3& offset) && = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
 	virtual ~Base() {}
 };
 
+class Zeeman;
+class Stretch;
+template <typename T>
+class Affine;
+
+template <typename T>
+std::unique_ptr<Base> release_base_model(T&, arma::vec3&, arma::vec3&) {
+	return nullptr;
+}
+std::unique_ptr<Base> release_base_model(Zeeman& model, arma::vec3& lambdas,
+					 arma::vec3& offset);
+std::unique_ptr<Base> release_base_model(Stretch& model, arma::vec3& lambdas,
+					 arma::vec3& offset);
+
+template <typename T>
+std::unique_ptr<Base> fuse_model(T&& model, const arma::vec3& lambdas,
+				 const arma::vec3& offset);
+template <typename T>
+std::unique_ptr<Base> fuse_model(Affine<T>&& model, const arma::vec3& lambdas,
+				 const arma::vec3& offset);
+
+// Replaces a chain of affine decorators (Zeeman, Stretch) on top of a model
+// by one fused model, other models are returned unchanged.
+std::unique_ptr<Base> flatten(std::unique_ptr<Base> model);
+
 template <typename T>
 class Subclass_policy : public Base, private T {
        public:
 	using base_t = Base;
 	explicit Subclass_policy(const T& t) : T(t) {}
 	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
+	}
 	arma::vec3 omega(const arma::vec3& k) const override {
 		return T::omega(k);
 	}
+	void omega(const arma::mat& k, arma::mat& result) const override {
+		T::omega(k, result);
+	}
+	std::unique_ptr<Base> release_base_model(arma::vec3& lambdas,
+						 arma::vec3& offset) override {
+		return SOCModel::release_base_model(static_cast<T&>(*this),
+						    lambdas, offset);
+	}
+	std::unique_ptr<Base> fuse(const arma::vec3& lambdas,
+				   const arma::vec3& offset) && override {
+		return fuse_model(std::move(static_cast<T&>(*this)), lambdas,
+				  offset);
+	}
 };
 
 template <typename T>
@@ -56,6 +112,7 @@ class Isotropic3D {
        public:
 	Isotropic3D(double omega) : o(omega) {}
 	arma::vec3 omega(const arma::vec3& k) const;
+	void omega(const arma::mat& k, arma::mat& result) const;
 
 	static constexpr const auto& name = "Isotropic3D";
 	static constexpr const auto& keywords =
@@ -70,6 +127,7 @@ class Dresselhaus {
        public:
 	Dresselhaus(double omega) : o(omega) {}
 	arma::vec3 omega(const arma::vec3& k) const;
+	void omega(const arma::mat& k, arma::mat& result) const;
 
 	static constexpr const auto& name = "Dresselhaus";
 	static constexpr const auto& keywords =
@@ -85,7 +143,14 @@ class Zeeman {
        public:
 	Zeeman(const arma::vec3& bfield, std::unique_ptr<Base> base_model)
 	    : bfield(bfield), base_model(std::move(base_model)) {}
+	Zeeman(const Zeeman& other)
+	    : bfield(other.bfield), base_model(other.base_model->clone()) {}
+	Zeeman(Zeeman&&) = default;
 	arma::vec3 omega(const arma::vec3& k) const;
+	friend std::unique_ptr<Base> release_base_model(Zeeman& model,
+							arma::vec3& lambdas,
+							arma::vec3& offset);
+	void omega(const arma::mat& k, arma::mat& result) const;
 
 	static constexpr const auto& name = "Zeeman";
 	static constexpr const auto& keywords =
@@ -104,7 +169,14 @@ class Stretch {
        public:
 	Stretch(const arma::vec3& lambdas, std::unique_ptr<Base> base_model)
 	    : lambdas(lambdas), base_model(std::move(base_model)) {}
+	Stretch(const Stretch& other)
+	    : lambdas(other.lambdas), base_model(other.base_model->clone()) {}
+	Stretch(Stretch&&) = default;
 	arma::vec3 omega(const arma::vec3& k) const;
+	friend std::unique_ptr<Base> release_base_model(Stretch& model,
+							arma::vec3& lambdas,
+							arma::vec3& offset);
+	void omega(const arma::mat& k, arma::mat& result) const;
 
 	static constexpr const auto& name = "Stretch";
 	static constexpr const auto& keywords =
@@ -115,6 +187,54 @@ class Stretch {
 	}
 };
 
+// Fused chain of affine decorators, built by flatten()
+//
+// Holds the innermost model by value, so evaluating it is a single virtual
+// call with the base model inlined.
+template <typename T>
+class Affine {
+       private:
+	T base_model;
+	arma::vec3 lambdas;
+	arma::vec3 offset;
+
+       public:
+	Affine(T&& base_model, const arma::vec3& lambdas,
+	       const arma::vec3& offset)
+	    : base_model(std::move(base_model)),
+	      lambdas(lambdas),
+	      offset(offset) {}
+	arma::vec3 omega(const arma::vec3& k) const {
+		return lambdas % base_model.omega(k) + offset;
+	}
+	void omega(const arma::mat& k, arma::mat& result) const {
+		base_model.omega(k, result);
+		result.each_row() %= lambdas.t();
+		result.each_row() += offset.t();
+	}
+
+	template <typename U>
+	friend std::unique_ptr<Base> fuse_model(Affine<U>&& model,
+						const arma::vec3& lambdas,
+						const arma::vec3& offset);
+};
+
+template <typename T>
+std::unique_ptr<Base> fuse_model(T&& model, const arma::vec3& lambdas,
+				 const arma::vec3& offset) {
+	return std::make_unique<Subclass_policy<Affine<T>>>(
+	    Affine<T>(std::move(model), lambdas, offset));
+}
+
+// Composition: lambdas % (inner.lambdas % base + inner.offset) + offset
+template <typename T>
+std::unique_ptr<Base> fuse_model(Affine<T>&& model, const arma::vec3& lambdas,
+				 const arma::vec3& offset) {
+	model.offset = lambdas % model.offset + offset;
+	model.lambdas = lambdas % model.lambdas;
+	return std::make_unique<Subclass_policy<Affine<T>>>(std::move(model));
+}
+
 }  // namespace SOCModel
 
 namespace YAML {
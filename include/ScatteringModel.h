@@ -1,13 +1,18 @@
 #ifndef SCATTERING_MODEL_H
 #define SCATTERING_MODEL_H
 
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <ostream>
 #include <string>
+#include <vector>
 
 #include <yaml-cpp/yaml.h>
 #include <armadillo>
 
+#include "Random.h"
 #include "RegisterSubclass.h"
 #include "arraysize.h"
 #include "yaml_utils.h"
@@ -40,6 +45,10 @@ class Base {
        public:
 	static const auto& get_factories() { return factories(); }
 	virtual Event NextEvent(const arma::vec3& k0) = 0;
+	// Comment lines on the events drawn so far, if the model counts them
+	virtual void print_statistics(std::ostream& out) const = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
 	virtual ~Base() {}
 };
 
@@ -49,9 +58,16 @@ class Subclass_policy : public Base, private T {
 	using base_t = Base;
 	explicit Subclass_policy(const T& t) : T(t) {}
 	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
+	}
 	Event NextEvent(const arma::vec3& k0) override {
 		return T::NextEvent(k0);
 	}
+	void print_statistics(std::ostream& out) const override {
+		T::print_statistics(out);
+	}
 };
 
 template <typename T>
@@ -65,6 +81,7 @@ class Isotropic3D {
 	Isotropic3D(double scattering_rate)
 	    : scattering_rate(scattering_rate) {}
 	Event NextEvent(const arma::vec3& k0);
+	void print_statistics(std::ostream&) const {}
 
 	static constexpr const auto& name = "Isotropic3D";
 	static constexpr const auto& keywords =
@@ -74,6 +91,284 @@ class Isotropic3D {
 	}
 };
 
+// Differential cross-sections as functions of the cosine of the scattering
+// angle, up to normalisation
+namespace CrossSection {
+
+class Base {
+       public:
+	class Factory {
+	       public:
+		virtual std::unique_ptr<Base> create_from_YAML(
+		    const YAML::Node&) = 0;
+		virtual ~Factory() {}
+	};
+
+       private:
+	static auto& factories() {
+		static std::map<std::string, std::unique_ptr<Factory>> f;
+		return f;
+	};
+	template <typename Base, typename Child>
+	friend RegisterSubclass<Base, Child>::Register::Register();
+
+       public:
+	static const auto& get_factories() { return factories(); }
+	virtual double density(double cos_theta) const = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
+	virtual ~Base() {}
+};
+
+template <typename T>
+class Subclass_policy : public Base, private T {
+       public:
+	using base_t = Base;
+	explicit Subclass_policy(const T& t) : T(t) {}
+	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
+	}
+	double density(double cos_theta) const override {
+		return T::density(cos_theta);
+	}
+};
+
+template <typename T>
+using Subclass = PolyphormicSubclass<T, Subclass_policy>;
+
+// values at equally spaced cos theta from -1 to 1, interpolated linearly
+class Table {
+       private:
+	std::vector<double> values;
+
+       public:
+	Table(const std::vector<double>& values);
+	double density(double cos_theta) const;
+
+	static constexpr const auto& name = "Table";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("values");
+	static auto factory(const std::vector<double>& values) {
+		return Table(values);
+	}
+};
+
+// sum_l coefficients[l] P_l(cos theta), has to be non-negative
+class Legendre {
+       private:
+	std::vector<double> coefficients;
+
+       public:
+	Legendre(const std::vector<double>& coefficients);
+	double density(double cos_theta) const;
+
+	static constexpr const auto& name = "Legendre";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("coefficients");
+	static auto factory(const std::vector<double>& coefficients) {
+		return Legendre(coefficients);
+	}
+};
+
+// (1 - g^2) / (1 + g^2 - 2 g cos theta)^(3/2), forward peaked for g near 1
+class HenyeyGreenstein {
+       private:
+	double g;
+
+       public:
+	HenyeyGreenstein(double g);
+	double density(double cos_theta) const;
+
+	static constexpr const auto& name = "HenyeyGreenstein";
+	static constexpr const auto& keywords = make_array<const char*>("g");
+	static auto factory(double g) { return HenyeyGreenstein(g); }
+};
+
+}  // namespace CrossSection
+
+// Scattering at a constant rate into a direction at angle theta to k0, with
+// a density proportional to cross_section in cos theta and uniform in the
+// azimuth around k0. |k| is conserved.
+//
+// The density is interpolated linearly between its values at bins + 1
+// equally spaced cos theta. An alias table draws the interval in O(1), then
+// cos theta is drawn from the linear density on it by inversion. A Table is
+// sampled exactly if its number of intervals divides bins.
+class Anisotropic3D {
+       private:
+	double scattering_rate;
+	std::vector<double> nodes;  // density at the interval boundaries
+	Random::AliasTable intervals;
+
+       public:
+	Anisotropic3D(double scattering_rate,
+		      std::unique_ptr<CrossSection::Base>&& cross_section,
+		      unsigned int bins);
+	Event NextEvent(const arma::vec3& k0);
+	void print_statistics(std::ostream&) const {}
+
+	static constexpr const auto& name = "Anisotropic3D";
+	static constexpr const auto& keywords = make_array<const char*>(
+	    "scattering_rate", "cross_section", "bins");
+	static constexpr const auto& defaults =
+	    make_array<const char*>(nullptr, nullptr, "1024");
+	static auto factory(double scattering_rate,
+			    std::unique_ptr<CrossSection::Base>&& cross_section,
+			    unsigned int bins) {
+		return Anisotropic3D(scattering_rate, std::move(cross_section),
+				     bins);
+	}
+};
+
+// Scattering rates as functions of k, with a bound used as the majorant
+namespace Rate {
+
+class Base {
+       public:
+	class Factory {
+	       public:
+		virtual std::unique_ptr<Base> create_from_YAML(
+		    const YAML::Node&) = 0;
+		virtual ~Factory() {}
+	};
+
+       private:
+	static auto& factories() {
+		static std::map<std::string, std::unique_ptr<Factory>> f;
+		return f;
+	};
+	template <typename Base, typename Child>
+	friend RegisterSubclass<Base, Child>::Register::Register();
+
+       public:
+	static const auto& get_factories() { return factories(); }
+	virtual double rate(const arma::vec3& k) const = 0;
+	virtual double majorant() const = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
+	virtual ~Base() {}
+};
+
+template <typename T>
+class Subclass_policy : public Base, private T {
+       public:
+	using base_t = Base;
+	explicit Subclass_policy(const T& t) : T(t) {}
+	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
+	}
+	double rate(const arma::vec3& k) const override { return T::rate(k); }
+	double majorant() const override { return T::majorant(); }
+};
+
+template <typename T>
+using Subclass = PolyphormicSubclass<T, Subclass_policy>;
+
+// scattering_rate |k|^exponent, bounded for k_min <= |k| <= k_max
+class PowerLaw {
+       private:
+	double scattering_rate;
+	double exponent;
+	double k_min;
+	double k_max;
+
+       public:
+	PowerLaw(double scattering_rate, double exponent, double k_min,
+		 double k_max);
+	double rate(const arma::vec3& k) const;
+	double majorant() const;
+
+	static constexpr const auto& name = "PowerLaw";
+	static constexpr const auto& keywords = make_array<const char*>(
+	    "scattering_rate", "exponent", "k_min", "k_max");
+	static constexpr const auto& defaults =
+	    make_array<const char*>(nullptr, nullptr, "0.", "1.");
+	static auto factory(double scattering_rate, double exponent,
+			    double k_min, double k_max) {
+		return PowerLaw(scattering_rate, exponent, k_min, k_max);
+	}
+};
+
+// rate_parallel for k along axis, rate_perpendicular for k normal to it and
+// quadratic in cos(k, axis) in between
+class Directional {
+       private:
+	arma::vec3 axis;
+	double rate_parallel;
+	double rate_perpendicular;
+
+       public:
+	Directional(const arma::vec3& axis, double rate_parallel,
+		    double rate_perpendicular);
+	double rate(const arma::vec3& k) const;
+	double majorant() const;
+
+	static constexpr const auto& name = "Directional";
+	static constexpr const auto& keywords = make_array<const char*>(
+	    "axis", "rate_parallel", "rate_perpendicular");
+	static auto factory(const arma::vec3& axis, double rate_parallel,
+			    double rate_perpendicular) {
+		return Directional(axis, rate_parallel, rate_perpendicular);
+	}
+};
+
+}  // namespace Rate
+
+// Scattering at a rate that depends on k, by Lewis-Shedler thinning
+//
+// Candidate events are drawn at the constant majorant of the rate, and each
+// is accepted with probability rate(k) / majorant. A rejected candidate is
+// a self-scattering event, which leaves k unchanged. The waiting time up to
+// the accepted candidate is exact. k is constant between events, so rate(k)
+// is evaluated once per event, and a rate above the majorant is an error.
+// The direction after an accepted event is drawn by base_model, whose
+// waiting time is discarded.
+//
+// The candidates and the self-scattering events are counted over all
+// threads and printed by print_statistics. A copy counts into counters of
+// its own and adds them to those of the model it was copied from when it is
+// destroyed, so workers with their own copies do not share the counters.
+//
+// The cost per event is about majorant / rate(k) candidates of two draws
+// each, the rejection rate printed shows it. While the rate only depends on
+// k, the waiting time could as well be drawn at rate(k) directly. Thinning
+// keeps the sampling exact for rates that change between events, such as
+// ones depending on time or on the field, so they can be added as Rates.
+class Thinning {
+       private:
+	struct Counters {
+		std::atomic<std::uint64_t> events{0};
+		std::atomic<std::uint64_t> self_scattering{0};
+	};
+
+	std::unique_ptr<Rate::Base> rate;
+	double majorant;
+	std::unique_ptr<Base> base_model;
+	std::shared_ptr<Counters> counters;
+	std::shared_ptr<Counters> parent;  // of the model copied from
+
+       public:
+	Thinning(std::unique_ptr<Rate::Base>&& rate,
+		 std::unique_ptr<Base>&& base_model);
+	Thinning(const Thinning& other);
+	Thinning(Thinning&&) = default;
+	~Thinning();
+	Event NextEvent(const arma::vec3& k0);
+	void print_statistics(std::ostream& out) const;
+
+	static constexpr const auto& name = "Thinning";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("rate", "base_model");
+	static auto factory(std::unique_ptr<Rate::Base>&& rate,
+			    std::unique_ptr<Base>&& base_model) {
+		return Thinning(std::move(rate), std::move(base_model));
+	}
+};
+
 }  // namespace ScatteringModel
 
 namespace YAML {
@@ -81,6 +376,12 @@ namespace YAML {
 template <>
 std::unique_ptr<ScatteringModel::Base> Node::as() const;
 
+template <>
+std::unique_ptr<ScatteringModel::CrossSection::Base> Node::as() const;
+
+template <>
+std::unique_ptr<ScatteringModel::Rate::Base> Node::as() const;
+
 }  // namespace YAML
 
 #endif  // SCATTERING_MODEL_H
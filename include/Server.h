@@ -0,0 +1,54 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <ostream>
+#include <string>
+
+#include "Random.h"
+#include "dprw.h"
+
+// Job daemon on a Unix domain socket
+//
+// The daemon keeps a pool of worker threads and a queue of jobs ordered by
+// priority, higher first, and by arrival among equal priorities. A running
+// job is not preempted. Every job is one connection:
+//
+//   client: job <priority> <option count> <config bytes> [<seed>]\n
+//           <name>\n<value>\n   for every option
+//           <config>             the YAML of the measurement
+//   server: # <column>, <column>, ...\n
+//           <value>, <value>, ...\n   for every record, as it is produced
+//           done <seconds>\n     or   error <message>\n
+//
+// The threads of a job, "auto" included, are capped at the hardware
+// concurrency divided by the workers, at least 1, so that the jobs running
+// at once do not oversubscribe the machine. The random engine of the worker
+// is seeded with seed, default_seed if it is left out, before every job.
+// The records of a job are therefore the same as those of a run of
+// DP_random_walk with the same config and the capped thread count,
+// whichever worker runs it and whatever ran there before.
+//
+// The records are written with max_digits10 significant digits. The output
+// of the config is ignored. A connection sending "shutdown\n" stops the
+// daemon after the queued jobs are finished. Requests are read on threads
+// of their own, a client has 10 seconds to send its whole request.
+
+namespace Server {
+
+// Serves until a shutdown request, a socket at socket_path is replaced,
+// any other file there is an error. Errors of accept are logged and do not
+// stop the daemon.
+void serve(const std::string& socket_path, unsigned int workers);
+
+// Runs a job on the daemon at socket_path and copies the header and the
+// records to out. Throws std::runtime_error with the message of the daemon
+// if the job fails.
+void submit(const std::string& socket_path, const std::string& config,
+	    const dprw::Options& options, int priority, std::ostream& out,
+	    random_engine::result_type seed = random_engine::default_seed);
+
+void shutdown(const std::string& socket_path);
+
+}  // namespace Server
+
+#endif  // SERVER_H
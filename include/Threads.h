@@ -0,0 +1,109 @@
+#ifndef UUID_5544F344_D428_4CAD_888F_5387B5AB5BD8
+#define UUID_5544F344_D428_4CAD_888F_5387B5AB5BD8
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+// Worker thread count and placement
+//
+// The usable CPUs are the ones in the affinity mask of the process, limited
+// by the smallest CPU quota of its cgroup, found in /proc/self/cgroup, and
+// the ancestors of it. The NUMA topology is read from sysfs, if it is not
+// available every CPU is considered to be on node 0.
+
+namespace Threads {
+
+// Number of worker threads, "auto" in YAML selects hardware_concurrency()
+struct Count {
+	unsigned int value;
+};
+
+// none: leave the placement to the scheduler
+// compact: fill the CPUs of one NUMA node before moving to the next
+// scatter: distribute the workers round-robin over the NUMA nodes
+enum class Pin { none, compact, scatter };
+
+struct Placement {
+	int cpu;
+	int node;
+};
+
+unsigned int hardware_concurrency();
+
+// Most worker threads of a measurement built on the calling thread, 0 for
+// no limit. Count caps "auto" and explicit counts at it.
+unsigned int& thread_limit();
+
+// CPUs in the order in which workers are assigned to them
+std::vector<int> cpu_order(Pin pin);
+
+// Pins the calling thread to cpu, returns false if it is not possible
+bool pin_current_thread(int cpu);
+
+// The CPU the calling thread is running on and its NUMA node, -1 if unknown
+Placement current_placement();
+
+}  // namespace Threads
+
+namespace YAML {
+
+template <>
+struct convert<Threads::Count> {
+	static Node encode(const Threads::Count& rhs) {
+		return Node(rhs.value);
+	}
+
+	static bool decode(const Node& node, Threads::Count& rhs) {
+		if (!node.IsScalar()) {
+			return false;
+		}
+		if (node.Scalar() == "auto") {
+			rhs.value = Threads::hardware_concurrency();
+		} else {
+			rhs.value = node.as<unsigned int>();
+		}
+		const auto limit = Threads::thread_limit();
+		if (limit > 0) {
+			rhs.value = std::min(rhs.value, limit);
+		}
+		return rhs.value > 0;
+	}
+};
+
+template <>
+struct convert<Threads::Pin> {
+	static Node encode(const Threads::Pin& rhs) {
+		switch (rhs) {
+			case Threads::Pin::compact:
+				return Node("compact");
+			case Threads::Pin::scatter:
+				return Node("scatter");
+			default:
+				return Node("none");
+		}
+	}
+
+	static bool decode(const Node& node, Threads::Pin& rhs) {
+		if (!node.IsScalar()) {
+			return false;
+		}
+		const auto& value = node.Scalar();
+		if (value == "none") {
+			rhs = Threads::Pin::none;
+		} else if (value == "compact") {
+			rhs = Threads::Pin::compact;
+		} else if (value == "scatter") {
+			rhs = Threads::Pin::scatter;
+		} else {
+			return false;
+		}
+		return true;
+	}
+};
+
+}  // namespace YAML
+
+#endif  //  UUID_5544F344_D428_4CAD_888F_5387B5AB5BD8
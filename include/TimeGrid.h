@@ -0,0 +1,153 @@
+#ifndef TIME_GRID_H
+#define TIME_GRID_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include "RegisterSubclass.h"
+
+namespace TimeGrid {
+
+// Sample times relative to t0, ascending and in [0, duration)
+//
+// steps[i] is the nominal distance from times[i] to times[i + 1]. On uniform
+// pieces it is exactly the step of the piece, so the spin rotation over one
+// step can be reused from sample to sample.
+struct Grid {
+	std::vector<double> times;
+	std::vector<double> steps;
+
+	size_t size() const { return times.size(); }
+};
+
+class Base {
+       public:
+	class Factory {
+	       public:
+		virtual std::unique_ptr<Base> create_from_YAML(
+		    const YAML::Node&) = 0;
+		virtual ~Factory() {}
+	};
+
+       private:
+	static auto& factories() {
+		static std::map<std::string, std::unique_ptr<Factory>> f;
+		return f;
+	};
+	template <typename Base, typename Child>
+	friend RegisterSubclass<Base, Child>::Register::Register();
+
+       public:
+	static const auto& get_factories() { return factories(); }
+	virtual Grid grid(double duration) const = 0;
+	// Deep copy
+	virtual std::unique_ptr<Base> clone() const = 0;
+	virtual ~Base() {}
+};
+
+template <typename T>
+class Subclass_policy : public Base, private T {
+       public:
+	using base_t = Base;
+	explicit Subclass_policy(const T& t) : T(t) {}
+	explicit Subclass_policy(T&& t) : T(std::move(t)) {}
+	std::unique_ptr<Base> clone() const override {
+		return std::make_unique<Subclass_policy>(
+		    static_cast<const T&>(*this));
+	}
+	Grid grid(double duration) const override {
+		return T::grid(duration);
+	}
+};
+
+template <typename T>
+using Subclass = PolyphormicSubclass<T, Subclass_policy>;
+
+// i * time_step for i < duration / time_step
+class Uniform {
+       private:
+	double time_step;
+
+       public:
+	Uniform(double time_step);
+	Grid grid(double duration) const;
+
+	static constexpr const auto& name = "Uniform";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("time_step");
+	static auto factory(double time_step) { return Uniform(time_step); }
+};
+
+// 0 followed by points - 1 times spaced logarithmically from first up to,
+// but excluding, duration
+class Logarithmic {
+       private:
+	double first;
+	unsigned int points;
+
+       public:
+	Logarithmic(double first, unsigned int points);
+	Grid grid(double duration) const;
+
+	static constexpr const auto& name = "Logarithmic";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("first", "points");
+	static auto factory(double first, unsigned int points) {
+		return Logarithmic(first, points);
+	}
+};
+
+// Uniform with time_steps[i] from breaks[i] up to breaks[i + 1], the last
+// break is capped at duration
+class Piecewise {
+       private:
+	std::vector<double> breaks;
+	std::vector<double> time_steps;
+
+       public:
+	Piecewise(const std::vector<double>& breaks,
+		  const std::vector<double>& time_steps);
+	Grid grid(double duration) const;
+
+	static constexpr const auto& name = "Piecewise";
+	static constexpr const auto& keywords =
+	    make_array<const char*>("breaks", "time_steps");
+	static auto factory(const std::vector<double>& breaks,
+			    const std::vector<double>& time_steps) {
+		return Piecewise(breaks, time_steps);
+	}
+};
+
+// Times read from a text file, one per line, '#' starts a comment
+class File {
+       private:
+	std::vector<double> times;
+
+       public:
+	File(const std::string& path);
+	Grid grid(double duration) const;
+
+	static constexpr const auto& name = "File";
+	static constexpr const auto& keywords = make_array<const char*>("path");
+	static auto factory(const std::string& path) { return File(path); }
+};
+
+// The grid of time_grid, or the uniform grid of time_step if time_grid is
+// null. Exactly one of them has to be given.
+Grid make_grid(const Base* time_grid, double time_step, double duration);
+
+}  // namespace TimeGrid
+
+namespace YAML {
+
+// Null gives nullptr
+template <>
+std::unique_ptr<TimeGrid::Base> Node::as() const;
+
+}  // namespace YAML
+
+#endif  // TIME_GRID_H
@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Timeline of the activity of the threads, as Chrome trace-event JSON
+//
+// Off by default, DP_random_walk records with --trace <file> and writes the
+// file when the process exits, it can be opened in Perfetto or
+// chrome://tracing. A Scope records one complete event, its begin and end
+// time, on the track of the calling thread.
+//
+// Threads with the same name share a track, e.g. the workers of the
+// successive windows of an Ensamble. Every track has a ring buffer, which
+// grows up to buffer_events and then keeps the last buffer_events events.
+// The first event of a thread takes the buffer of its track under a lock,
+// or a new one if another running thread holds it. The thread gives the
+// buffer back when it exits. All other events are recorded without locks.
+
+namespace Trace {
+
+constexpr size_t buffer_events = 1 << 15;
+
+std::atomic<bool>& enabled();
+
+// Starts recording, the trace is written to path at exit
+void start(const std::string& path);
+
+// Names the track of the calling thread, "thread <n>" if it has none
+void name_thread(const std::string& name);
+
+namespace detail {
+std::int64_t now();
+void record(const char* name, std::int64_t begin, std::int64_t end);
+}  // namespace detail
+
+// Records an event from construction to destruction, name has to be a
+// string literal
+class Scope {
+       private:
+	const char* name;
+	std::int64_t begin = 0;
+
+       public:
+	explicit Scope(const char* name)
+	    : name(enabled().load(std::memory_order_relaxed) ? name : nullptr) {
+		if (this->name) {
+			begin = detail::now();
+		}
+	}
+	~Scope() {
+		if (name) {
+			detail::record(name, begin, detail::now());
+		}
+	}
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+};
+
+// The events recorded so far, while no thread records
+void write(std::ostream& out);
+
+}  // namespace Trace
+
+#endif  // TRACE_H
@@ -0,0 +1,917 @@
+#ifndef UUID_58466825_EEB8_495D_89E7_A0C977D0FE18
+#define UUID_58466825_EEB8_495D_89E7_A0C977D0FE18
+
+#include <algorithm>
+#include <condition_variable>
+#include <initializer_list>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <armadillo>
+
+#include "InitialCondition.h"
+#include "MagneticField.h"
+#include "Misc.h"
+#include "Observable.h"
+#include "PerfCounters.h"
+#include "Rotation.h"
+#include "SOCModel.h"
+#include "ScatteringModel.h"
+#include "TimeGrid.h"
+#include "Trace.h"
+
+namespace Trajectory {
+
+// Piece of a trajectory with constant Hamiltonian
+//
+// omega is the total precession vector on the segment, i.e. the SOC
+// precession of k modified by the magnetic field, spin is the spin at
+// t_start.
+template <typename real>
+struct Segment {
+	double t_start;
+	double t_end;
+	arma::vec3 k;
+	arma::vec3 omega;
+	Rotation::vec3<real> spin;
+};
+
+// State of a paused trajectory, see Generator::save
+template <typename real>
+struct Checkpoint {
+	InitialCondition::State state;
+	MagneticField::Interval field;
+	Rotation::vec3<real> spin;
+	double t;
+	arma::vec3 k;
+	double last_t;
+	bool exhausted;
+	// Scattering segment containing t, drawn before the pause
+	bool pending;
+	double pending_end;
+	arma::vec3 pending_k;
+	arma::vec3 pending_omega;
+	// Antithetic mode only
+	Rotation::vec3<real> mirrored_spin;
+	arma::vec3 pending_mirrored_omega;
+};
+
+// Lazy generator of the segments of one trajectory after the other
+//
+// Scattering events are drawn in blocks, the SOC precession of a block is
+// evaluated with one batched call. Segments are split at the
+// discontinuities of the magnetic field (none if magnetic_field is null) and
+// the last one is cut at t_end.
+//
+// A trajectory can be paused at any time with pause_at, saved, and resumed
+// later with restore, possibly after other trajectories were generated in
+// between. No scattering event beyond the pause is drawn before it is
+// resumed.
+//
+// In antithetic mode every trajectory is generated together with its mirror
+// image, which has the same scattering times and -k in place of every k.
+// This is an equally likely trajectory if the initial condition and the
+// scattering model are symmetric under k -> -k.
+template <typename real>
+class Generator {
+       private:
+	static constexpr size_t block_size = 64;
+
+	InitialCondition::Base& initial_condition;
+	ScatteringModel::Base& scattering_model;
+	SOCModel::Base& soc_model;
+	const MagneticField::Base* magnetic_field;
+	double t0;
+	double t_end;
+	double pause;
+	bool antithetic;
+
+	InitialCondition::State state;
+	MagneticField::Interval field;
+	Rotation::vec3<real> spin;
+	Rotation::vec3<real> mirrored_spin;
+	double t;         // start of the next segment
+	arma::vec3 k;     // k after the last generated scattering event
+	double last_t;    // time of the last generated scattering event
+	bool exhausted;  // the last block reaches t_end
+
+	std::vector<double> block_end;  // end of the scattering segments
+	arma::mat k_block;
+	arma::mat omega_block;
+	arma::mat mirrored_omega_block;
+	size_t block_pos;
+
+	void fill_block() {
+		PerfCounters::Scope scope(PerfCounters::Phase::generation);
+		block_end.clear();
+		k_block.set_size(block_size, 3);
+		while (block_end.size() < block_size && !exhausted &&
+		       last_t < pause) {
+			const auto row = block_end.size();
+			k_block(row, 0) = k[0];
+			k_block(row, 1) = k[1];
+			k_block(row, 2) = k[2];
+
+			const auto event = scattering_model.NextEvent(k);
+			last_t += event.t;
+			k = event.k;
+			if (last_t >= t_end) {
+				last_t = t_end;
+				exhausted = true;
+			}
+			block_end.push_back(last_t);
+		}
+		k_block.resize(block_end.size(), 3);
+		soc_model.omega(k_block, omega_block);
+		if (antithetic) {
+			soc_model.omega(arma::mat(-k_block), mirrored_omega_block);
+		}
+		block_pos = 0;
+	}
+
+	MagneticField::Interval field_interval(double time) const {
+		if (magnetic_field) {
+			return magnetic_field->interval(time);
+		}
+		return MagneticField::Interval{
+		    std::numeric_limits<double>::infinity(), 1.,
+		    arma::vec3(arma::fill::zeros)};
+	}
+
+       public:
+	Generator(InitialCondition::Base& initial_condition,
+		  ScatteringModel::Base& scattering_model,
+		  SOCModel::Base& soc_model,
+		  const MagneticField::Base* magnetic_field, double t0,
+		  double t_end, bool antithetic = false)
+	    : initial_condition(initial_condition),
+	      scattering_model(scattering_model),
+	      soc_model(soc_model),
+	      magnetic_field(magnetic_field),
+	      t0(t0),
+	      t_end(t_end),
+	      pause(t_end),
+	      antithetic(antithetic) {}
+
+	// Rolls the initial state of trajectory index out of count
+	const InitialCondition::State& start(size_t index, size_t count) {
+		PerfCounters::Scope scope(PerfCounters::Phase::generation);
+		state = initial_condition.roll(index, count);
+		field = field_interval(t0);
+		spin = Rotation::cast<real>(state.spin);
+		mirrored_spin = spin;
+		t = t0;
+		k = state.k;
+		last_t = t0;
+		exhausted = false;
+		block_end.clear();
+		block_pos = 0;
+		return state;
+	}
+
+	const InitialCondition::State& initial_state() const { return state; }
+
+	// Bytes of the block buffers of a generator
+	static size_t memory(bool antithetic) {
+		return block_size * (antithetic ? 10 : 7) * sizeof(double);
+	}
+
+	// Stops the current trajectory at time, t_end by default
+	void pause_at(double time) { pause = std::min(time, t_end); }
+
+	// State of the current trajectory, after next returned false
+	Checkpoint<real> save() const {
+		auto result = Checkpoint<real>{};
+		result.state = state;
+		result.field = field;
+		result.spin = spin;
+		result.t = t;
+		result.k = k;
+		result.last_t = last_t;
+		result.exhausted = exhausted;
+		result.mirrored_spin = mirrored_spin;
+		result.pending = false;
+		if (block_pos < block_end.size()) {
+			result.pending = true;
+			result.pending_end = block_end[block_pos];
+			for (size_t i = 0; i < 3; ++i) {
+				result.pending_k[i] = k_block(block_pos, i);
+				result.pending_omega[i] =
+				    omega_block(block_pos, i);
+				if (antithetic) {
+					result.pending_mirrored_omega[i] =
+					    mirrored_omega_block(block_pos, i);
+				}
+			}
+		}
+		return result;
+	}
+
+	// Continues a saved trajectory
+	void restore(const Checkpoint<real>& checkpoint) {
+		state = checkpoint.state;
+		field = checkpoint.field;
+		spin = checkpoint.spin;
+		t = checkpoint.t;
+		k = checkpoint.k;
+		last_t = checkpoint.last_t;
+		exhausted = checkpoint.exhausted;
+		mirrored_spin = checkpoint.mirrored_spin;
+		block_end.clear();
+		block_pos = 0;
+		if (checkpoint.pending) {
+			block_end.push_back(checkpoint.pending_end);
+			k_block.set_size(1, 3);
+			omega_block.set_size(1, 3);
+			mirrored_omega_block.set_size(1, 3);
+			for (size_t i = 0; i < 3; ++i) {
+				k_block(0, i) = checkpoint.pending_k[i];
+				omega_block(0, i) = checkpoint.pending_omega[i];
+				mirrored_omega_block(0, i) =
+				    checkpoint.pending_mirrored_omega[i];
+			}
+		}
+	}
+
+	// Next segment of the current trajectory, false after the last one
+	// or at the pause
+	bool next(Segment<real>& segment) { return next(segment, nullptr); }
+
+	// Next segment of the current trajectory and of its mirror image, in
+	// antithetic mode
+	bool next(Segment<real>& segment, Segment<real>& mirrored) {
+		return next(segment, &mirrored);
+	}
+
+       private:
+	bool next(Segment<real>& segment, Segment<real>* mirrored) {
+		if (t >= pause) {
+			return false;
+		}
+		if (block_pos == block_end.size()) {
+			if (exhausted) {
+				return false;
+			}
+			fill_block();
+		}
+
+		const auto scattering_end = block_end[block_pos];
+		const auto end = std::min({scattering_end, field.end, pause});
+		const arma::vec3 soc_omega{omega_block(block_pos, 0),
+					   omega_block(block_pos, 1),
+					   omega_block(block_pos, 2)};
+
+		segment.t_start = t;
+		segment.t_end = end;
+		segment.k = arma::vec3{k_block(block_pos, 0),
+				       k_block(block_pos, 1),
+				       k_block(block_pos, 2)};
+		segment.omega = field.precession(soc_omega);
+		segment.spin = spin;
+
+		spin = Misc::Rotate(
+		    spin, Rotation::cast<real>(segment.omega * (end - t)));
+		if (mirrored) {
+			const arma::vec3 mirrored_soc_omega{
+			    mirrored_omega_block(block_pos, 0),
+			    mirrored_omega_block(block_pos, 1),
+			    mirrored_omega_block(block_pos, 2)};
+			mirrored->t_start = t;
+			mirrored->t_end = end;
+			mirrored->k = -segment.k;
+			mirrored->omega = field.precession(mirrored_soc_omega);
+			mirrored->spin = mirrored_spin;
+			mirrored_spin = Misc::Rotate(
+			    mirrored_spin,
+			    Rotation::cast<real>(mirrored->omega * (end - t)));
+		}
+		t = end;
+		if (end == scattering_end) {
+			++block_pos;
+		}
+		if (field.end <= t) {
+			field = field_interval(t);
+		}
+		return true;
+	}
+};
+
+namespace detail {
+
+// Calls next(item) until it returns false and sink(item) for every item,
+// counted in the propagation and the sampling phase by batches
+template <typename Item, typename Next, typename Sink>
+void batched(Next&& next, Sink&& sink) {
+	constexpr size_t batch_size = 256;
+	thread_local std::vector<Item> batch(batch_size);
+	for (auto more = true; more;) {
+		size_t size = 0;
+		{
+			PerfCounters::Scope scope(
+			    PerfCounters::Phase::propagation);
+			while (size < batch_size && (more = next(batch[size]))) {
+				++size;
+			}
+		}
+		PerfCounters::Scope scope(PerfCounters::Phase::sampling);
+		for (size_t i = 0; i < size; ++i) {
+			sink(batch[i]);
+		}
+	}
+}
+
+}  // namespace detail
+
+// Hands the segments of the current trajectory up to the pause or the end
+// to sink(segment). While PerfCounters are enabled they are generated in
+// batches, so that the propagation of the spin and the consumers of the
+// segments are counted apart.
+template <typename real, typename Sink>
+void drain(Generator<real>& generator, Sink&& sink) {
+	if (PerfCounters::enabled().load(std::memory_order_relaxed)) {
+		detail::batched<Segment<real>>(
+		    [&](Segment<real>& segment) {
+			    return generator.next(segment);
+		    },
+		    sink);
+		return;
+	}
+	Segment<real> segment;
+	while (generator.next(segment)) {
+		sink(segment);
+	}
+}
+
+// The same for a trajectory and its mirror image, sink(segment, mirrored)
+template <typename real, typename Sink>
+void drain_antithetic(Generator<real>& generator, Sink&& sink) {
+	using pair = std::pair<Segment<real>, Segment<real>>;
+	if (PerfCounters::enabled().load(std::memory_order_relaxed)) {
+		detail::batched<pair>(
+		    [&](pair& segments) {
+			    return generator.next(segments.first,
+						  segments.second);
+		    },
+		    [&](const pair& segments) {
+			    sink(segments.first, segments.second);
+		    });
+		return;
+	}
+	Segment<real> segment;
+	Segment<real> mirrored;
+	while (generator.next(segment, mirrored)) {
+		sink(segment, mirrored);
+	}
+}
+
+// Receiver of the segments of trajectories
+template <typename real>
+class Consumer {
+       public:
+	virtual void begin(const InitialCondition::State& state) = 0;
+	virtual void segment(const Segment<real>& segment) = 0;
+	virtual void end() {}
+	virtual ~Consumer() {}
+};
+
+// Consumer that can take up a trajectory in the middle, see TimeSplit
+//
+// resume(t, forward, backward) is called before the segments from t on,
+// when the ones before t went to other consumers. forward is the product of
+// the segment rotations from the start of the trajectory to t, backward the
+// product of their inverses in the same order, both the identity unless
+// the TimeSplit tracks them.
+template <typename real>
+class ResumableConsumer : public Consumer<real> {
+       public:
+	virtual void resume(
+	    double t, const Rotation::basic_matrix_rotation<real>& forward,
+	    const Rotation::basic_matrix_rotation<real>& backward) = 0;
+};
+
+// Generates trajectory index out of count and feeds it to all the consumers
+// in one pass
+template <typename real>
+void run(Generator<real>& generator, size_t index, size_t count,
+	 std::initializer_list<Consumer<real>*> consumers) {
+	const auto& state = generator.start(index, count);
+	for (auto consumer : consumers) {
+		consumer->begin(state);
+	}
+	drain(generator, [&](const Segment<real>& segment) {
+		for (auto consumer : consumers) {
+			consumer->segment(segment);
+		}
+	});
+	for (auto consumer : consumers) {
+		consumer->end();
+	}
+}
+
+// Sums over antithetic pairs of the spin components a of a trajectory and
+// b of its mirror image, one column per sample
+struct PairStatistics {
+	arma::mat a, b, aa, bb, ab;
+
+	explicit PairStatistics(size_t size)
+	    : a(3, size, arma::fill::zeros),
+	      b(3, size, arma::fill::zeros),
+	      aa(3, size, arma::fill::zeros),
+	      bb(3, size, arma::fill::zeros),
+	      ab(3, size, arma::fill::zeros) {}
+
+	void merge(const PairStatistics& other) {
+		a += other.a;
+		b += other.b;
+		aa += other.aa;
+		bb += other.bb;
+		ab += other.ab;
+	}
+};
+
+// Hands the spin at the times t0 + grid.times[i] (first <= i < end) to the
+// accumulators of the observables, at column i - first
+//
+// Consecutive samples inside one segment with the same grid step differ by
+// the same rotation, which is built once. A trajectory and its mirror image
+// are sampled together, which also fills pair_statistics if it is not null.
+template <typename real>
+class Sampler : public ResumableConsumer<real> {
+       private:
+	using rotation = Rotation::basic_matrix_rotation<real>;
+
+	double t0;
+	const TimeGrid::Grid& grid;
+	size_t first;
+	size_t end;
+	std::vector<Observable::Accumulator>& accumulators;
+	PairStatistics* pair_statistics;
+	arma::vec3 initial_spin;
+	size_t next_sample;
+
+       public:
+	Sampler(double t0, const TimeGrid::Grid& grid, size_t first, size_t end,
+		std::vector<Observable::Accumulator>& accumulators,
+		PairStatistics* pair_statistics = nullptr)
+	    : t0(t0),
+	      grid(grid),
+	      first(first),
+	      end(end),
+	      accumulators(accumulators),
+	      pair_statistics(pair_statistics),
+	      next_sample(first) {}
+
+	// Also called when a trajectory is resumed at sample first
+	void begin(const InitialCondition::State& state) override {
+		initial_spin = state.spin;
+		next_sample = first;
+	}
+
+	// Skips the samples up to t, they are taken by the consumer of the
+	// segment ending at t
+	void resume(double t, const rotation&, const rotation&) override {
+		while (next_sample < end && time(next_sample) <= t) {
+			++next_sample;
+		}
+	}
+
+	void segment(const Segment<real>& segment) override {
+		if (!next_in(segment)) {
+			return;
+		}
+		auto st = Misc::Rotate(
+		    segment.spin,
+		    Rotation::cast<real>(segment.omega *
+					 (time(next_sample) - segment.t_start)));
+		add(segment, st);
+		++next_sample;
+		auto step_dt = 0.;
+		rotation step;
+		while (next_in(segment)) {
+			const auto dt = grid.steps[next_sample - 1];
+			if (dt != step_dt) {
+				step_dt = dt;
+				step = rotation(
+				    Rotation::cast<real>(segment.omega * dt));
+			}
+			st = step * st;
+			add(segment, st);
+			++next_sample;
+		}
+	}
+
+	void segment(const Segment<real>& segment,
+		     const Segment<real>& mirrored) {
+		if (!next_in(segment)) {
+			return;
+		}
+		const auto dt = time(next_sample) - segment.t_start;
+		auto st = Misc::Rotate(segment.spin,
+				       Rotation::cast<real>(segment.omega * dt));
+		auto mirrored_st = Misc::Rotate(
+		    mirrored.spin, Rotation::cast<real>(mirrored.omega * dt));
+		add(segment, mirrored, st, mirrored_st);
+		auto step_dt = 0.;
+		rotation step, mirrored_step;
+		while (next_in(segment)) {
+			const auto dt = grid.steps[next_sample - 1];
+			if (dt != step_dt) {
+				step_dt = dt;
+				step = rotation(
+				    Rotation::cast<real>(segment.omega * dt));
+				mirrored_step = rotation(
+				    Rotation::cast<real>(mirrored.omega * dt));
+			}
+			st = step * st;
+			mirrored_st = mirrored_step * mirrored_st;
+			add(segment, mirrored, st, mirrored_st);
+		}
+	}
+
+       private:
+	double time(size_t i) const { return t0 + grid.times[i]; }
+
+	bool next_in(const Segment<real>& segment) const {
+		return next_sample < end && time(next_sample) <= segment.t_end;
+	}
+
+	void add(const Segment<real>& segment,
+		 const Rotation::vec3<real>& st) {
+		const arma::vec3 spin{st[0], st[1], st[2]};
+		const auto sample =
+		    Observable::Sample{time(next_sample), spin,
+				       segment.k, initial_spin};
+		for (auto& accumulator : accumulators) {
+			accumulator.add(next_sample - first, sample);
+		}
+	}
+
+	void add(const Segment<real>& segment, const Segment<real>& mirrored,
+		 const Rotation::vec3<real>& st,
+		 const Rotation::vec3<real>& mirrored_st) {
+		add(segment, st);
+		add(mirrored, mirrored_st);
+		if (pair_statistics) {
+			const auto i = next_sample - first;
+			for (size_t j = 0; j < 3; ++j) {
+				const double a = st[j];
+				const double b = mirrored_st[j];
+				pair_statistics->a(j, i) += a;
+				pair_statistics->b(j, i) += b;
+				pair_statistics->aa(j, i) += a * a;
+				pair_statistics->bb(j, i) += b * b;
+				pair_statistics->ab(j, i) += a * b;
+			}
+		}
+		++next_sample;
+	}
+};
+
+// Thrown by the other threads of a TimeSplit after one of them failed
+class Aborted : public std::runtime_error {
+       public:
+	Aborted()
+	    : std::runtime_error{"Aborted after an error in another thread."} {
+	}
+};
+
+// Parallel in time propagation, one trajectory after the other with every
+// trajectory split over parts threads
+//
+// Every one of the threads calls run with its part and its consumer. Part 0
+// draws the scattering events ahead, chunk_events per part at a time, in
+// the order of Generator, so a trajectory is the one Generator would
+// produce from the same random engine. The events are split into one chunk
+// of consecutive segments per part. Every part builds the rotations of the
+// segments of its chunk and their product, in parallel. The products are
+// combined by a sequential scan over the parts, which gives every chunk
+// the spin at its start, and the segments of the chunk are handed to the
+// consumer of the part. Part 0 draws the next events while the others
+// are still busy with theirs.
+//
+// begin is called on every consumer, end only on the one of part 0 once
+// all parts are done with the trajectory. Errors abort the other parts,
+// which throw Aborted.
+template <typename real>
+class TimeSplit {
+       public:
+	using rotation = Rotation::basic_matrix_rotation<real>;
+	static constexpr size_t chunk_events = 4096;
+
+       private:
+	class Barrier {
+	       private:
+		std::mutex mutex;
+		std::condition_variable released;
+		unsigned int count;
+		unsigned int waiting = 0;
+		unsigned long generation = 0;
+		bool aborted = false;
+
+	       public:
+		explicit Barrier(unsigned int count) : count(count) {}
+
+		void wait() {
+			Trace::Scope scope("barrier");
+			std::unique_lock<std::mutex> lock(mutex);
+			const auto current = generation;
+			if (++waiting == count) {
+				waiting = 0;
+				++generation;
+				released.notify_all();
+			} else {
+				released.wait(lock, [&] {
+					return aborted || generation != current;
+				});
+			}
+			if (aborted) {
+				throw Aborted{};
+			}
+		}
+
+		void abort() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				aborted = true;
+			}
+			released.notify_all();
+		}
+	};
+
+	struct Chunk {
+		std::vector<Segment<real>> segments;
+		std::vector<rotation> rotations;
+		rotation forward;
+		rotation backward;
+	};
+
+	InitialCondition::Base& initial_condition;
+	ScatteringModel::Base& scattering_model;
+	SOCModel::Base& soc_model;
+	const MagneticField::Base* magnetic_field;
+	double t0;
+	double t_end;
+	unsigned int parts;
+	bool track_rotations;
+	Barrier barrier;
+
+	// Written by part 0 while the other parts wait or process chunks
+	InitialCondition::State state;
+	arma::vec3 k;        // k after the last drawn event
+	double last_t;       // time of the last drawn event
+	bool exhausted;      // the last drawn event reaches t_end
+	double events_start;  // start of the first drawn segment
+	std::vector<double> event_end;
+	arma::mat event_k;
+	// Spin and rotations at the start of the current events, and at
+	// their end once the chunks are done
+	Rotation::vec3<real> spin, next_spin;
+	rotation forward, next_forward;
+	rotation backward, next_backward;
+
+	std::vector<Chunk> chunks;
+
+	MagneticField::Interval field_interval(double time) const {
+		if (magnetic_field) {
+			return magnetic_field->interval(time);
+		}
+		return MagneticField::Interval{
+		    std::numeric_limits<double>::infinity(), 1.,
+		    arma::vec3(arma::fill::zeros)};
+	}
+
+	void start(size_t index, size_t count) {
+		PerfCounters::Scope scope(PerfCounters::Phase::generation);
+		state = initial_condition.roll(index, count);
+		k = state.k;
+		last_t = t0;
+		exhausted = false;
+		next_spin = Rotation::cast<real>(state.spin);
+		next_forward = rotation::identity();
+		next_backward = rotation::identity();
+	}
+
+	void draw() {
+		PerfCounters::Scope scope(PerfCounters::Phase::generation);
+		events_start = last_t;
+		const auto size = parts * chunk_events;
+		event_end.clear();
+		event_k.set_size(size, 3);
+		while (event_end.size() < size && !exhausted) {
+			const auto row = event_end.size();
+			event_k(row, 0) = k[0];
+			event_k(row, 1) = k[1];
+			event_k(row, 2) = k[2];
+
+			const auto event = scattering_model.NextEvent(k);
+			last_t += event.t;
+			k = event.k;
+			if (last_t >= t_end) {
+				last_t = t_end;
+				exhausted = true;
+			}
+			event_end.push_back(last_t);
+		}
+	}
+
+	// Events [first, last) of the part, the empty chunks come last
+	void range(unsigned int part, size_t& first, size_t& last) const {
+		const auto size = event_end.size();
+		const auto per_part = (size + parts - 1) / parts;
+		first = std::min(size, part * per_part);
+		last = std::min(size, first + per_part);
+	}
+
+	void build(unsigned int part) {
+		PerfCounters::Scope scope(PerfCounters::Phase::propagation);
+		auto& chunk = chunks[part];
+		chunk.segments.clear();
+		chunk.rotations.clear();
+		chunk.forward = rotation::identity();
+		chunk.backward = rotation::identity();
+		size_t first, last;
+		range(part, first, last);
+		if (first == last) {
+			return;
+		}
+
+		auto k_block = arma::mat(last - first, 3);
+		for (size_t i = first; i < last; ++i) {
+			for (size_t j = 0; j < 3; ++j) {
+				k_block(i - first, j) = event_k(i, j);
+			}
+		}
+		arma::mat omega_block;
+		soc_model.omega(k_block, omega_block);
+
+		auto t = first == 0 ? events_start : event_end[first - 1];
+		auto field = field_interval(t);
+		for (size_t i = first; i < last; ++i) {
+			const auto row = i - first;
+			const arma::vec3 soc_omega{omega_block(row, 0),
+						   omega_block(row, 1),
+						   omega_block(row, 2)};
+			// Split at the discontinuities of the field as in
+			// Generator::next
+			do {
+				const auto end = std::min(event_end[i], field.end);
+				auto segment = Segment<real>{};
+				segment.t_start = t;
+				segment.t_end = end;
+				segment.k = arma::vec3{k_block(row, 0),
+						       k_block(row, 1),
+						       k_block(row, 2)};
+				segment.omega = field.precession(soc_omega);
+				const auto r = rotation(Rotation::cast<real>(
+				    segment.omega * (end - t)));
+				chunk.forward = r * chunk.forward;
+				if (track_rotations) {
+					chunk.backward =
+					    r.inverse() * chunk.backward;
+				}
+				chunk.segments.push_back(segment);
+				chunk.rotations.push_back(r);
+				t = end;
+				if (field.end <= t) {
+					field = field_interval(t);
+				}
+			} while (t < event_end[i]);
+		}
+	}
+
+	// Hands the chunk of the part to consumer, the chunks before it are
+	// built
+	void feed(unsigned int part, bool first_events,
+		  ResumableConsumer<real>& consumer) {
+		PerfCounters::Scope scope(PerfCounters::Phase::sampling);
+		auto& chunk = chunks[part];
+		if (chunk.segments.empty()) {
+			return;
+		}
+		auto current = spin;
+		auto f = forward;
+		auto b = backward;
+		for (unsigned int i = 0; i < part; ++i) {
+			current = chunks[i].forward * current;
+			if (track_rotations) {
+				f = chunks[i].forward * f;
+				b = chunks[i].backward * b;
+			}
+		}
+		if (!(first_events && part == 0)) {
+			consumer.resume(chunk.segments.front().t_start, f, b);
+		}
+		for (size_t i = 0; i < chunk.segments.size(); ++i) {
+			auto& segment = chunk.segments[i];
+			segment.spin = current;
+			consumer.segment(segment);
+			current = chunk.rotations[i] * current;
+		}
+	}
+
+	// Spin and rotations after all chunks, for the next events
+	void advance() {
+		PerfCounters::Scope scope(PerfCounters::Phase::propagation);
+		next_spin = spin;
+		next_forward = forward;
+		next_backward = backward;
+		for (const auto& chunk : chunks) {
+			next_spin = chunk.forward * next_spin;
+			if (track_rotations) {
+				next_forward = chunk.forward * next_forward;
+				next_backward = chunk.backward * next_backward;
+			}
+		}
+	}
+
+	void process(unsigned int part, size_t count,
+		     ResumableConsumer<real>& consumer) {
+		for (size_t index = 0; index < count; ++index) {
+			Trace::Scope scope("trajectory");
+			if (part == 0) {
+				start(index, count);
+				draw();
+			}
+			barrier.wait();
+			consumer.begin(state);
+			for (auto first_events = true;; first_events = false) {
+				if (part == 0) {
+					spin = next_spin;
+					forward = next_forward;
+					backward = next_backward;
+				}
+				build(part);
+				const auto last = exhausted;
+				barrier.wait();
+				feed(part, first_events, consumer);
+				if (part == 0) {
+					advance();
+					if (!last) {
+						draw();
+					}
+				}
+				barrier.wait();
+				if (last) {
+					break;
+				}
+			}
+			if (part == 0) {
+				consumer.end();
+			}
+		}
+	}
+
+       public:
+	// track_rotations selects whether the consumers get the rotations
+	// from the start of the trajectory in resume
+	TimeSplit(InitialCondition::Base& initial_condition,
+		  ScatteringModel::Base& scattering_model,
+		  SOCModel::Base& soc_model,
+		  const MagneticField::Base* magnetic_field, double t0,
+		  double t_end, unsigned int parts, bool track_rotations = false)
+	    : initial_condition(initial_condition),
+	      scattering_model(scattering_model),
+	      soc_model(soc_model),
+	      magnetic_field(magnetic_field),
+	      t0(t0),
+	      t_end(t_end),
+	      parts(parts),
+	      track_rotations(track_rotations),
+	      barrier(parts),
+	      forward(rotation::identity()),
+	      backward(rotation::identity()),
+	      chunks(parts) {}
+
+	// Bytes of the events drawn ahead, shared by the parts
+	static size_t shared_memory(unsigned int parts) {
+		return parts * chunk_events * 4 * sizeof(double);
+	}
+
+	// Bytes of the chunk of one part, without the splits at the
+	// discontinuities of the field
+	static size_t part_memory() {
+		return chunk_events * (sizeof(Segment<real>) + sizeof(rotation) +
+				       6 * sizeof(double));
+	}
+
+	// Propagates the trajectories 0 to count - 1, called by each of the
+	// parts threads
+	void run(unsigned int part, size_t count,
+		 ResumableConsumer<real>& consumer) {
+		try {
+			process(part, count, consumer);
+		} catch (const Aborted&) {
+			throw;
+		} catch (...) {
+			barrier.abort();
+			throw;
+		}
+	}
+};
+
+}  // namespace Trajectory
+
+#endif  //  UUID_58466825_EEB8_495D_89E7_A0C977D0FE18
@@ -0,0 +1,61 @@
+#ifndef DPRW_H
+#define DPRW_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+#include <armadillo>
+
+#include "Measurement.h"
+#include "Output.h"
+#include "Random.h"
+
+// In-process API of libdprw
+//
+// Runs a measurement described by the same YAML as DP_random_walk takes and
+// returns its records and its report in memory. The output of the config is
+// ignored and may be left out, nothing is written to files or to the log.
+//
+// The random engine of the calling thread is seeded with seed before the
+// run, so a call gives the same result as DP_random_walk with the same
+// config, whichever thread makes it and whatever ran there before. Calls on
+// different threads are independent.
+
+namespace dprw {
+
+// Values of the !option tags of the config, like --name value on the command
+// line
+using Options = std::map<std::string, std::string>;
+
+struct Result {
+	// type of the measurement
+	std::string type;
+	// Column names, the first is t
+	std::vector<std::string> columns;
+	// One row per sample time
+	arma::mat values;
+	// Workers, statistics and counters, DP_random_walk logs them with
+	// Measurement::print
+	Measurement::Report report;
+	// Wall time of the run
+	double seconds;
+};
+
+Result run(const YAML::Node& config, const Options& options = {},
+	   random_engine::result_type seed = random_engine::default_seed);
+// config is YAML text
+Result run(const std::string& config, const Options& options = {},
+	   random_engine::result_type seed = random_engine::default_seed);
+
+// Hands the records to output as they are produced instead, columns and
+// values of the result are left empty
+Result run(const YAML::Node& config, const Options& options,
+	   std::unique_ptr<Output::Base>&& output,
+	   random_engine::result_type seed = random_engine::default_seed);
+
+}  // namespace dprw
+
+#endif  // DPRW_H
@@ -6,7 +6,9 @@
 
 namespace globals {
 
-extern std::map<std::string, std::string> options;
+// Values of the !option tags, per thread so that the library API can build
+// measurements on several threads at once
+extern thread_local std::map<std::string, std::string> options;
 
 }  // namespace globals
 
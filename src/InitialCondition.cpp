@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -5,7 +8,6 @@ using namespace std::string_literals;
 
 #include <yaml-cpp/yaml.h>
 #include <armadillo>
-#include <boost/random/uniform_on_sphere.hpp>
 
 #include "InitialCondition.h"
 #include "Misc.h"
@@ -31,16 +33,97 @@ std::unique_ptr<InitialCondition::Base> Node::as() const {
 namespace InitialCondition {
 
 State Isotropic3D::roll() {
-	boost::random::uniform_on_sphere<double, arma::vec> RandUnitVec(3);
-
-	return State{RandUnitVec(get_random_engine()),
-		     RandUnitVec(get_random_engine())};
+	auto& engine = get_random_engine();
+	const auto k = Random::unit_vector(engine);
+	return State{k, Random::unit_vector(engine)};
 }
 
 State Polarized3D::roll() {
-	boost::random::uniform_on_sphere<double, arma::vec> RandUnitVec(3);
+	return State{Random::unit_vector(get_random_engine()), this->spin};
+}
+
+namespace {
+
+// Uniform random rotation, from a uniform unit quaternion
+arma::mat33 random_rotation(random_engine& engine) {
+	double q[4];
+	double norm = 0.;
+	do {
+		norm = 0.;
+		for (auto& x : q) {
+			x = Random::normal(engine);
+			norm += x * x;
+		}
+	} while (norm == 0.);
+	norm = std::sqrt(norm);
+	const auto w = q[0] / norm, x = q[1] / norm, y = q[2] / norm,
+		   z = q[3] / norm;
+	return arma::mat33{
+	    {1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w)},
+	    {2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w)},
+	    {2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)}};
+}
+
+// Point on the sphere of the uniform coordinates (u, v), area-preserving
+arma::vec3 sphere_point(double u, double v) {
+	const auto z = 1. - 2. * u;
+	const auto r = std::sqrt(std::max(0., 1. - z * z));
+	const auto phi = 2. * arma::datum::pi * v;
+	return arma::vec3{r * std::cos(phi), r * std::sin(phi), z};
+}
+
+// Coordinate dimension (0 or 1) of Sobol point index, as a 32 bit fraction
+//
+// Dimension 0 is the van der Corput sequence, dimension 1 has the primitive
+// polynomial x + 1 with the direction numbers m_1 = 1, m_j = 2 m_(j-1) xor
+// m_(j-1), i.e. 1, 3, 5, 15, 17, 51, ...
+std::uint32_t sobol(size_t index, int dimension) {
+	std::uint32_t result = 0;
+	std::uint32_t m = 1;
+	for (int j = 1; index && j <= 32; ++j, index >>= 1) {
+		if (index & 1) {
+			result ^= (dimension == 0 ? 1u : m) << (32 - j);
+		}
+		m ^= m << 1;
+	}
+	return result;
+}
+
+}  // namespace
+
+Fibonacci3D::Fibonacci3D(const arma::vec3& spin)
+    : spin(spin), rotation(random_rotation(get_random_engine())) {}
 
-	return State{RandUnitVec(get_random_engine()), this->spin};
+State Fibonacci3D::roll() {
+	return State{Random::unit_vector(get_random_engine()), this->spin};
+}
+
+State Fibonacci3D::roll(size_t index, size_t count) {
+	const auto golden_ratio = (1. + std::sqrt(5.)) / 2.;
+	const auto turns = index / golden_ratio;
+	const arma::vec3 k = sphere_point((index + 0.5) / count,
+					  turns - std::floor(turns));
+	return State{rotation * k, this->spin};
+}
+
+Sobol3D::Sobol3D(const arma::vec3& spin) : spin(spin) {
+	auto& engine = get_random_engine();
+	for (auto& s : shift) {
+		s = (std::uint32_t)(engine() >> 32);
+	}
+}
+
+State Sobol3D::roll() {
+	return State{Random::unit_vector(get_random_engine()), this->spin};
+}
+
+State Sobol3D::roll(size_t index, size_t) {
+	const auto scale = 1. / 4294967296.;
+	return State{sphere_point((sobol(index, 0) ^ shift[0]) * scale +
+				      scale / 2.,
+				  (sobol(index, 1) ^ shift[1]) * scale +
+				      scale / 2.),
+		     this->spin};
 }
 
 }  // namespace InitialCondition
@@ -49,3 +132,7 @@ template class RegisterSubclass2<InitialCondition::Isotropic3D,
 				 InitialCondition::Subclass_policy>;
 template class RegisterSubclass2<InitialCondition::Polarized3D,
 				 InitialCondition::Subclass_policy>;
+template class RegisterSubclass2<InitialCondition::Fibonacci3D,
+				 InitialCondition::Subclass_policy>;
+template class RegisterSubclass2<InitialCondition::Sobol3D,
+				 InitialCondition::Subclass_policy>;
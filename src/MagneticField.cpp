@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -28,42 +30,64 @@ std::unique_ptr<MagneticField::Base> Node::as() const {
 
 namespace MagneticField {
 
-const arma::vec3 Zero::advance(const arma::vec3& s0, double t0, double t,
-			       const arma::vec3& bconst) {
-	return Misc::Rotate(s0, bconst * (t - t0));
+const arma::vec3 Base::advance(const arma::vec3& s0, double t0, double t,
+			       const arma::vec3& bconst) const {
+	return MagneticField::advance<double>(*this, s0, t0, t, bconst);
 }
 
-const arma::vec3 Step::advance(const arma::vec3& s0, double t0, double t,
-			       const arma::vec3& bconst) {
-	if (t0 < this->tstep) {
-		if (t < this->tstep) {
-			return Misc::Rotate(s0, bconst * (t - t0));
-		} else {
-			arma::vec3 sAtTstep =
-			    Misc::Rotate(s0, bconst * (tstep - t0));
-			return Misc::Rotate(
-			    s0, (bconst + this->field) * (t - tstep));
-		}
+Interval Zero::interval(double) const {
+	return Interval{std::numeric_limits<double>::infinity(), 1.,
+			arma::vec3(arma::fill::zeros)};
+}
+
+Interval Step::interval(double t) const {
+	if (t < this->tstep) {
+		return Interval{tstep, 1., arma::vec3(arma::fill::zeros)};
 	} else {
-		return Misc::Rotate(s0, (bconst + this->field) * (t - t0));
+		return Interval{std::numeric_limits<double>::infinity(), 1.,
+				field};
 	}
 }
 
-const arma::vec3 Echo::advance(const arma::vec3& s0, double t0, double t,
-			       const arma::vec3& bconst) {
-	if (t0 < this->tflip) {
-		if (t < this->tflip) {
-			return Misc::Rotate(s0, bconst * (t - t0));
-		} else {
-			return Misc::Rotate(s0, bconst * (2 * tflip - t0 - t));
-		}
+Interval Echo::interval(double t) const {
+	if (t < this->tflip) {
+		return Interval{tflip, 1., arma::vec3(arma::fill::zeros)};
 	} else {
-		return Misc::Rotate(s0, -bconst * (t - t0));
+		return Interval{std::numeric_limits<double>::infinity(), -1.,
+				arma::vec3(arma::fill::zeros)};
 	}
 }
 
+PulseSequence::PulseSequence(const std::vector<Event>& events) {
+	auto current = Interval{0., 1., arma::vec3(arma::fill::zeros)};
+	for (const auto& event : events) {
+		if (!times.empty() && event.t < times.back()) {
+			throw std::invalid_argument{
+			    "\"events\" must be sorted by time."};
+		}
+		current.end = event.t;
+		intervals.push_back(current);
+		times.push_back(event.t);
+
+		if (event.flip) {
+			current.sign = -current.sign;
+		}
+		if (event.set_field) {
+			current.field = event.field;
+		}
+	}
+	current.end = std::numeric_limits<double>::infinity();
+	intervals.push_back(current);
+}
+
+Interval PulseSequence::interval(double t) const {
+	const auto it = std::upper_bound(times.begin(), times.end(), t);
+	return intervals[it - times.begin()];
+}
+
 }  // namespace MagneticField
 
 template class RegisterSubclass2<MagneticField::Zero, MagneticField::Subclass_policy>;
 template class RegisterSubclass2<MagneticField::Step, MagneticField::Subclass_policy>;
 template class RegisterSubclass2<MagneticField::Echo, MagneticField::Subclass_policy>;
+template class RegisterSubclass2<MagneticField::PulseSequence, MagneticField::Subclass_policy>;
@@ -1,7 +1,14 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <iostream>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
-#include <future>	
+#include <thread>
+#include <vector>
 using namespace std::string_literals;
 
 #include <yaml-cpp/yaml.h>
@@ -10,10 +17,16 @@ using namespace std::string_literals;
 #include "InitialCondition.h"
 #include "MagneticField.h"
 #include "Measurement.h"
+#include "Observable.h"
+#include "PerfCounters.h"
 #include "SOCModel.h"
 #include "ScatteringModel.h"
 #include "Misc.h"
+#include "Random.h"
 #include "Rotation.h"
+#include "Threads.h"
+#include "Trace.h"
+#include "Trajectory.h"
 
 namespace YAML {
 
@@ -34,390 +47,1124 @@ std::unique_ptr<Measurement::Base> Node::as() const {
 
 namespace Measurement {
 
+namespace {
+
+// Spins after the pulses and rotations at the echoes of a trajectory,
+// shared by the EchoRotations of the parts of a split trajectory
+struct Echoes {
+	std::vector<arma::vec3> pulse_spins;
+	std::vector<Rotation::rotation> echo_rotations;
+
+	// Bytes stored for a grid of size samples
+	static size_t memory(size_t size) {
+		return size * (sizeof(arma::vec3) + sizeof(Rotation::rotation));
+	}
+
+	explicit Echoes(size_t size)
+	    : pulse_spins(size, arma::vec3(arma::fill::zeros)),
+	      echo_rotations(size, Rotation::rotation::identity()) {}
+};
+
+// Rotations of a trajectory at half the sample times and at the sample
+// times, from which EchoDecay accumulates the echo spin
+//
+// The spin after the pulse at tau / 2 and the rotation at its echo at tau
+// are kept in echoes and combined by end, so only size spins and rotations
+// are stored per trajectory. Split in time the pulse and its echo may fall
+// to different parts.
+class EchoRotations : public Trajectory::ResumableConsumer<double> {
+       private:
+	// Pulse for sample i at times[i] / 2 or its echo at times[i], step is
+	// the nominal time since the previous mark, 0 at the same time
+	struct Mark {
+		double t;
+		size_t i;
+		bool echo;
+		double step;
+	};
+
+	double t0;
+	Echoes& echoes;
+	arma::mat& result;
+	std::vector<Mark> marks;
+	arma::vec3 first_spin;
+	size_t next;
+	// Rotations from t0 to the start of the current segment
+	Rotation::rotation rotation_start;
+	Rotation::rotation invrotation_start;
+
+       public:
+	// Bytes of the marks for a grid of size samples, besides the echoes
+	static size_t memory(size_t size) { return 2 * size * sizeof(Mark); }
+
+	EchoRotations(double t0, const TimeGrid::Grid& grid, Echoes& echoes,
+		      arma::mat& result)
+	    : t0(t0), echoes(echoes), result(result) {
+		// Merge of the two ascending sequences, a pulse comes before
+		// the echoes at the same time. The step of a mark is the
+		// nominal step of the grid where the previous mark is the
+		// previous pulse or echo, so uniform grids step by
+		// time_step / 2 throughout.
+		size_t pulse = 0, echo = 0;
+		auto previous = 0.;
+		while (echo < grid.size()) {
+			auto mark = Mark{};
+			if (pulse < grid.size() &&
+			    grid.times[pulse] / 2. <= grid.times[echo]) {
+				mark = Mark{grid.times[pulse] / 2., pulse, false,
+					    0.};
+				if (pulse > 0 &&
+				    previous == grid.times[pulse - 1] / 2.) {
+					mark.step = grid.steps[pulse - 1] / 2.;
+				}
+				++pulse;
+			} else {
+				mark = Mark{grid.times[echo], echo, true, 0.};
+				if (echo > 0 && previous == grid.times[echo - 1]) {
+					mark.step = grid.steps[echo - 1];
+				}
+				++echo;
+			}
+			if (!marks.empty()) {
+				if (mark.t == previous) {
+					mark.step = 0.;
+				} else if (mark.step == 0.) {
+					mark.step = mark.t - previous;
+				}
+			}
+			previous = mark.t;
+			marks.push_back(mark);
+		}
+	}
+
+	void begin(const InitialCondition::State& state) override {
+		first_spin = state.spin;
+		rotation_start = Rotation::rotation::identity();
+		invrotation_start = Rotation::rotation::identity();
+		next = 0;
+	}
+
+	void resume(double t, const Rotation::rotation& forward,
+		    const Rotation::rotation& backward) override {
+		rotation_start = forward;
+		invrotation_start = backward;
+		while (next < marks.size() && t0 + marks[next].t <= t) {
+			++next;
+		}
+	}
+
+	void segment(const Trajectory::Segment<double>& segment) override {
+		const auto& omega = segment.omega;
+		const auto first = next;
+		Rotation::rotation rotation, invrotation;
+		auto step_dt = 0.;
+		Rotation::rotation step, inverse_step;
+		for (; next < marks.size() &&
+		       t0 + marks[next].t <= segment.t_end;
+		     ++next) {
+			const auto& mark = marks[next];
+			if (next == first) {
+				const auto dt = t0 + mark.t - segment.t_start;
+				rotation =
+				    Rotation::rotation(arma::vec3(omega * dt)) *
+				    rotation_start;
+				invrotation =
+				    Rotation::rotation(arma::vec3(-omega * dt)) *
+				    invrotation_start;
+			} else if (mark.step != 0.) {
+				// The step rotation is reused while the marks
+				// are the same step apart
+				if (mark.step != step_dt) {
+					step_dt = mark.step;
+					step = Rotation::rotation(
+					    arma::vec3(omega * step_dt));
+					inverse_step = step.inverse();
+				}
+				rotation = step * rotation;
+				invrotation = inverse_step * invrotation;
+			}
+			if (mark.echo) {
+				echoes.echo_rotations[mark.i] = invrotation;
+			} else {
+				// Right-to-left multiplication is more
+				// performant
+				echoes.pulse_spins[mark.i] =
+				    invrotation.inverse() *
+				    (rotation * first_spin);
+			}
+		}
+
+		const auto dt = segment.t_end - segment.t_start;
+		rotation_start =
+		    Rotation::rotation(arma::vec3(omega * dt)) * rotation_start;
+		invrotation_start =
+		    Rotation::rotation(arma::vec3(-omega * dt)) *
+		    invrotation_start;
+	}
+
+	// Marks after t_end are not reached and add nothing
+	void end() override {
+		for (size_t i = 0; i < echoes.pulse_spins.size(); ++i) {
+			result.col(i) +=
+			    echoes.echo_rotations[i] * echoes.pulse_spins[i];
+			echoes.pulse_spins[i].zeros();
+		}
+	}
+};
+
+// Rotations of a trajectory composed in reverse order, for EchoDecayTest
+class EchoTestRotations : public Trajectory::Consumer<double> {
+       private:
+	double t0;
+	const TimeGrid::Grid& grid;
+	arma::mat& result;
+	arma::vec3 first_spin;
+	size_t next;
+	// Rotation from t0 to the start of the current segment
+	Rotation::rotation rotation_start;
+
+       public:
+	EchoTestRotations(double t0, const TimeGrid::Grid& grid,
+			  arma::mat& result)
+	    : t0(t0), grid(grid), result(result) {}
+
+	void begin(const InitialCondition::State& state) override {
+		first_spin = state.spin;
+		rotation_start = Rotation::rotation::identity();
+		next = 0;
+	}
+
+	void segment(const Trajectory::Segment<double>& segment) override {
+		const auto& omega = segment.omega;
+		if (next < grid.size() &&
+		    t0 + grid.times[next] <= segment.t_end) {
+			auto rotation =
+			    rotation_start *
+			    Rotation::rotation(arma::vec3(
+				omega * (t0 + grid.times[next] -
+					 segment.t_start)));
+			result.col(next) += rotation * first_spin;
+			++next;
+			auto step_dt = 0.;
+			Rotation::rotation step;
+			while (next < grid.size() &&
+			       t0 + grid.times[next] <= segment.t_end) {
+				const auto dt = grid.steps[next - 1];
+				if (dt != step_dt) {
+					step_dt = dt;
+					step = Rotation::rotation(
+					    arma::vec3(omega * dt));
+				}
+				rotation = rotation * step;
+				result.col(next) += rotation * first_spin;
+				++next;
+			}
+		}
+
+		rotation_start =
+		    rotation_start *
+		    Rotation::rotation(arma::vec3(
+			omega * (segment.t_end - segment.t_start)));
+	}
+};
+
+// Rethrows the first error of the parts of a Trajectory::TimeSplit, not the
+// Aborted of the parts stopped by it
+void rethrow_first_error(const std::vector<std::exception_ptr>& errors) {
+	for (const auto& error : errors) {
+		if (error) {
+			try {
+				std::rethrow_exception(error);
+			} catch (const Trajectory::Aborted&) {
+			}
+		}
+	}
+}
+
+// Trajectories of a worker recorded as one event of a Trace
+constexpr size_t trace_spins = 64;
+
+// Wall time spent on timing each kernel
+constexpr auto calibration_seconds = 0.1;
+// Scattering events of a shortened calibration trajectory
+constexpr auto calibration_events = 10000.;
+
+// Mean time of a call of f, called repeatedly for calibration_seconds
+template <typename F>
+double seconds_per_call(F f) {
+	using clock = std::chrono::steady_clock;
+	const auto start = clock::now();
+	size_t calls = 0;
+	std::chrono::duration<double> elapsed;
+	do {
+		f();
+		++calls;
+		elapsed = clock::now() - start;
+	} while (elapsed.count() < calibration_seconds);
+	return elapsed.count() / calls;
+}
+
+// Mean scattering rate over calibration_events consecutive events
+double scattering_rate(InitialCondition::Base& initial_condition,
+		       ScatteringModel::Base& scattering_model) {
+	auto k = initial_condition.roll().k;
+	auto time = 0.;
+	for (auto i = 0; i < calibration_events; ++i) {
+		const auto event = scattering_model.NextEvent(k);
+		time += event.t;
+		k = event.k;
+	}
+	return calibration_events / time;
+}
+
+// Time of drawing a scattering event alone, as part 0 of a
+// Trajectory::TimeSplit does for all the parts
+double draw_seconds(InitialCondition::Base& initial_condition,
+		    ScatteringModel::Base& scattering_model) {
+	auto k = initial_condition.roll().k;
+	return seconds_per_call([&] {
+		       for (auto i = 0; i < calibration_events; ++i) {
+			       k = scattering_model.NextEvent(k).k;
+		       }
+	       }) /
+	       calibration_events;
+}
+
+// Time per unit of simulated time of generating a trajectory and handing its
+// segments to feed(generator), measured on trajectories shortened to about
+// calibration_events events
+template <typename real, typename Feed>
+double segment_seconds(Trajectory::Generator<real>&& generator, double span,
+		       size_t count, Feed feed) {
+	size_t index = 0;
+	return seconds_per_call([&] {
+		       generator.start(index, count);
+		       index = (index + 1) % count;
+		       feed(generator);
+	       }) /
+	       span;
+}
+
+// Time of taking the samples of a trajectory by feed(segments), where the
+// segments cover [t0, t0 + duration] evenly. Their number is the expected
+// number of scattering segments, but not more than one per sample, as
+// segments without a sample are already timed by segment_seconds.
+template <typename real, typename Feed>
+double sample_seconds(const InitialCondition::State& state,
+		      SOCModel::Base& soc_model, double t0, double duration,
+		      double rate, size_t size, Feed feed) {
+	const auto count = (size_t)std::max(
+	    1., std::min(std::ceil(rate * duration), (double)size));
+	auto segments = std::vector<Trajectory::Segment<real>>(count);
+	for (size_t i = 0; i < count; ++i) {
+		auto& segment = segments[i];
+		segment.t_start = t0 + duration * i / count;
+		segment.t_end = t0 + duration * (i + 1) / count;
+		segment.k = state.k;
+		segment.omega = soc_model.omega(state.k);
+		segment.spin = Rotation::cast<real>(state.spin);
+	}
+	return seconds_per_call([&] { feed(segments); });
+}
+
+// The statistics of a scattering model as comment lines
+std::string statistics(const ScatteringModel::Base& scattering_model) {
+	std::ostringstream out;
+	scattering_model.print_statistics(out);
+	return out.str();
+}
+
+// Runs are only started with an output, which is optional in YAML for the
+// library API and for dry runs
+void check_output(const std::unique_ptr<Output::Base>& output) {
+	if (!output) {
+		throw std::invalid_argument{"\"output\" is missing."};
+	}
+}
+
+// Estimate of a sequential echo measurement, timed with idle on an empty
+// grid for the segments and with consumer on the grid of size samples.
+// consumer_memory are the bytes consumer keeps besides its 3 x size result.
+template <typename Consumer>
+Estimate echo_estimate(unsigned int spin_count, double duration, double t0,
+		       size_t size, InitialCondition::Base& initial_condition,
+		       ScatteringModel::Base& scattering_model,
+		       SOCModel::Base& soc_model, Consumer& idle,
+		       Consumer& consumer, size_t consumer_memory) {
+	const auto rate = scattering_rate(initial_condition, scattering_model);
+	const auto span = std::min(duration, calibration_events / rate);
+	const auto per_time = segment_seconds<double>(
+	    Trajectory::Generator<double>(initial_condition, scattering_model,
+					  soc_model, nullptr, t0, t0 + span),
+	    span, spin_count, [&idle](Trajectory::Generator<double>& generator) {
+		    Trajectory::Segment<double> segment;
+		    idle.begin(generator.initial_state());
+		    while (generator.next(segment)) {
+			    idle.segment(segment);
+		    }
+	    });
+	const auto state = initial_condition.roll(0, spin_count);
+	const auto samples = sample_seconds<double>(
+	    state, soc_model, t0, duration, rate, size,
+	    [&](const std::vector<Trajectory::Segment<double>>& segments) {
+		    consumer.begin(state);
+		    for (const auto& segment : segments) {
+			    consumer.segment(segment);
+		    }
+		    consumer.end();
+	    });
+
+	auto estimate = Estimate{};
+	estimate.events = spin_count * rate * duration;
+	estimate.trajectories = spin_count;
+	estimate.trajectory_seconds = per_time * duration + samples;
+	estimate.threads = 1;
+	estimate.parallel = false;
+	estimate.shared_memory = 2 * size * sizeof(double);
+	estimate.thread_memory = 3 * size * sizeof(double) + consumer_memory +
+				 Trajectory::Generator<double>::memory(false);
+	estimate.trajectory_memory = 0;
+	return estimate;
+}
+
+}  // namespace
+
+void print(std::ostream& out, const Estimate& estimate) {
+	const auto mib = 1. / (1 << 20);
+	out << "# expected scattering events: " << estimate.events << '\n'
+	    << "# time per trajectory [s]: " << estimate.trajectory_seconds
+	    << '\n';
+	if (estimate.split_in_time) {
+		out << "# of which on one thread [s]: "
+		    << estimate.serial_seconds << '\n';
+	}
+	out << "# shared memory [MiB]: " << estimate.shared_memory * mib
+	    << '\n';
+
+	auto counts = std::vector<unsigned int>{1};
+	if (estimate.parallel) {
+		const auto concurrency = Threads::hardware_concurrency();
+		for (auto n = 2u; n < concurrency; n *= 2) {
+			counts.push_back(n);
+		}
+		counts.push_back(concurrency);
+		counts.push_back(estimate.threads);
+		std::sort(counts.begin(), counts.end());
+		counts.erase(std::unique(counts.begin(), counts.end()),
+			     counts.end());
+	}
+	out << "# threads, memory per thread [MiB], wall time [s]\n";
+	for (const auto n : counts) {
+		// The slowest thread gets the rounded up share, or a part of
+		// every trajectory
+		auto share = (estimate.trajectories + n - 1) / n;
+		auto seconds = share * estimate.trajectory_seconds;
+		if (estimate.split_in_time) {
+			share = 0;
+			seconds = estimate.trajectories *
+				  (estimate.serial_seconds +
+				   (estimate.trajectory_seconds -
+				    estimate.serial_seconds) /
+				       n);
+		}
+		out << n << ", "
+		    << (estimate.thread_memory +
+			share * estimate.trajectory_memory) *
+			   mib
+		    << ", " << seconds
+		    << (n == estimate.threads ? "  # configured" : "") << '\n';
+	}
+}
+
+void print(std::ostream& out, const Report& report) {
+	for (size_t i = 0; i < report.workers.size(); ++i) {
+		const auto& start = report.workers[i].start;
+		const auto& end = report.workers[i].end;
+		out << "# worker " << i << ": cpu " << start.cpu << " node "
+		    << start.node;
+		if (end.cpu != start.cpu) {
+			out << " -> cpu " << end.cpu << " node " << end.node;
+		}
+		out << '\n';
+	}
+	if (report.variance_reduction > 0.) {
+		out << "# antithetic variance reduction: "
+		    << report.variance_reduction << '\n';
+	}
+	out << report.scattering_statistics;
+	PerfCounters::print(out, report.perf);
+}
+
 Ensamble::Ensamble(unsigned int spin_count, double duration, double time_step,
-		   double t0, unsigned int threads,
+		   std::unique_ptr<TimeGrid::Base>&& time_grid, double t0, unsigned int window, bool antithetic,
+		   Threads::Count threads,
+		   Threads::Pin pin, bool parallel_in_time,
+		   const std::string& precision, bool fast_math,
 		   std::unique_ptr<InitialCondition::Base>&& initial_condition,
 		   std::unique_ptr<ScatteringModel::Base>&& scattering_model,
 		   std::unique_ptr<MagneticField::Base>&& magnetic_field,
 		   std::unique_ptr<SOCModel::Base>&& soc_model,
+		   std::vector<std::unique_ptr<Observable::Base>>&& observables,
 		   std::unique_ptr<Output::Base>&& output)
     : spin_count(spin_count),
       duration(duration),
-      time_step(time_step),
+      grid(TimeGrid::make_grid(time_grid.get(), time_step, duration)),
       t0(t0),
-      threads(threads),
+      window(window),
+      antithetic(antithetic),
+      threads(threads.value),
+      pin(pin),
+      parallel_in_time(parallel_in_time),
+      single_precision(precision == "float"),
+      fast_math(fast_math),
       initial_condition(std::move(initial_condition)),
       scattering_model(std::move(scattering_model)),
       magnetic_field(std::move(magnetic_field)),
       soc_model(std::move(soc_model)),
+      observables(std::move(observables)),
       output(std::move(output)) {
-	if (duration <= 0) {
-		throw std::invalid_argument{"\"duration\" must be positive."};
+	if (antithetic && spin_count % 2 != 0) {
+		throw std::invalid_argument{
+		    "\"spin_count\" must be even with \"antithetic\"."};
+	}
+	if (this->observables.empty()) {
+		throw std::invalid_argument{
+		    "\"observables\" must not be empty."};
 	}
-	if (time_step <= 0) {
-		throw std::invalid_argument{"\"time_step\" must be positive."};
+	if (precision != "double" && precision != "float") {
+		throw std::invalid_argument{
+		    "\"precision\" must be \"double\" or \"float\"."};
 	}
-	if (time_step > duration) {
+	if (parallel_in_time && (window != 0 || antithetic)) {
 		throw std::invalid_argument{
-		    "\"time_step\" must not be larger than \"duration\"."};
+		    "\"parallel_in_time\" does not support \"window\" and "
+		    "\"antithetic\"."};
 	}
 }
 
-arma::mat Ensamble::do_run(unsigned int thread_nr) {
-	auto size = (size_t)(duration / time_step);
-	auto result = arma::mat(4, size, arma::fill::zeros);
+template <typename real>
+Report Ensamble::do_run() {
+	using namespace std;
+	const auto size = grid.size();
+	const auto window_size =
+	    window == 0 ? size : min((size_t)window, size);
+
+	// Seeding the workers from the engine of the calling thread keeps runs
+	// reproducible and the streams of the workers distinct.
+	auto seeds = vector<random_engine::result_type>(threads);
+	for (auto& seed : seeds) {
+		seed = get_random_engine()();
+	}
+	const auto cpus = Threads::cpu_order(pin);
+	// Only the counts of this run are reported
+	PerfCounters::take();
+
+	// State of a worker carried from one window to the next
+	struct WorkerState {
+		random_engine engine;
+		vector<Trajectory::Checkpoint<real>> checkpoints;
+		vector<Observable::Accumulator> accumulators;
+		Trajectory::PairStatistics pair_statistics{0};
+		Threads::Placement start;
+		Threads::Placement end;
+		exception_ptr error;
+		// Copies of the models private to the worker
+		unique_ptr<InitialCondition::Base> initial_condition;
+		unique_ptr<ScatteringModel::Base> scattering_model;
+		unique_ptr<SOCModel::Base> soc_model;
+		unique_ptr<MagneticField::Base> magnetic_field;
+		PerfCounters::Totals perf;
+	};
+	auto states = vector<WorkerState>(threads);
+
+	auto header = vector<string>{"t"};
+	for (const auto& observable : observables) {
+		const auto columns = observable->columns();
+		header.insert(header.end(), columns.begin(), columns.end());
+	}
+	output->write_header(header);
+
+	// Trajectories to generate, pairs of them in antithetic mode
+	const auto count = antithetic ? spin_count / 2 : spin_count;
+	// Sums over samples and components of the variance of the mean of a
+	// pair of independent and of a pair of antithetic trajectories
+	auto independent_variance = 0.;
+	auto antithetic_variance = 0.;
 
-	for (size_t k = 0; k < spin_count / thread_nr ; k++) {
-		auto times = std::vector<double>{};
-		auto spins = std::vector<arma::vec3>{};
-		auto kvecs = std::vector<arma::vec3>{};
+	for (size_t first = 0; first < size; first += window_size) {
+		const auto last = min(first + window_size, size);
+		const auto pause =
+		    last == size ? t0 + duration : t0 + grid.times[last];
 
-		// initial condition
+		vector<thread> workers;
+		for(unsigned int i = 0; i < threads; i++)
 		{
-			auto initial_state = initial_condition->roll();
+			workers.emplace_back([&, i] {
+				auto& state = states[i];
+				Trace::name_thread("worker " + to_string(i));
+				try {
+					if (pin != Threads::Pin::none) {
+						Threads::pin_current_thread(
+						    cpus[i % cpus.size()]);
+					}
+					if (first == 0) {
+						state.start =
+						    Threads::current_placement();
+						state.engine.seed(seeds[i]);
+						// Private copies of the models, also
+						// made after pinning
+						state.initial_condition =
+						    initial_condition->clone();
+						state.scattering_model =
+						    scattering_model->clone();
+						state.soc_model = soc_model->clone();
+						if (magnetic_field) {
+							state.magnetic_field =
+							    magnetic_field->clone();
+						}
+					}
+					get_random_engine() = state.engine;
+					Rotation::fast_math() = fast_math;
 
-			times.push_back(t0);
-			spins.push_back(initial_state.spin);
-			kvecs.push_back(initial_state.k);
-		}
+					// Each worker allocates its own
+					// accumulators after pinning, so the
+					// memory is first touched on the NUMA
+					// node it runs on.
+					state.accumulators.clear();
+					for (const auto& observable : observables) {
+						state.accumulators.emplace_back(
+						    *observable, last - first);
+					}
+					if (antithetic) {
+						state.pair_statistics =
+						    Trajectory::PairStatistics(
+							last - first);
+					}
+					const auto spins =
+					    count / threads + (i < count % threads);
+					const auto offset = i * (count / threads) +
+							    min(i, count % threads);
+					if (last < size) {
+						state.checkpoints.resize(spins);
+					}
+
+					auto generator = Trajectory::Generator<real>(
+					    *state.initial_condition,
+					    *state.scattering_model, *state.soc_model,
+					    state.magnetic_field.get(), t0,
+					    t0 + duration, antithetic);
+					generator.pause_at(pause);
+					auto sampler = Trajectory::Sampler<real>(
+					    t0, grid, first, last,
+					    state.accumulators,
+					    &state.pair_statistics);
+					for (size_t chunk = 0; chunk < spins;
+					     chunk += trace_spins) {
+						Trace::Scope scope("spins");
+						const auto end =
+						    min<size_t>(spins, chunk + trace_spins);
+						for (size_t k = chunk; k < end; k++) {
+							if (first == 0) {
+								generator.start(offset + k,
+										count);
+							} else {
+								generator.restore(
+								    state.checkpoints[k]);
+							}
+							sampler.begin(generator.initial_state());
+							if (antithetic) {
+								Trajectory::drain_antithetic(
+								    generator,
+								    [&](const auto& segment,
+									const auto& mirrored) {
+									    sampler.segment(
+										segment,
+										mirrored);
+								    });
+							} else {
+								Trajectory::drain(
+								    generator,
+								    [&](const auto& segment) {
+									    sampler.segment(
+										segment);
+								    });
+							}
+							if (last < size) {
+								state.checkpoints[k] =
+								    generator.save();
+							}
+						}
+					}
+					if (last == size) {
+						state.checkpoints.clear();
+						state.checkpoints.shrink_to_fit();
+					}
 
-		// steps
+					state.engine = get_random_engine();
+					state.end = Threads::current_placement();
+					state.perf += PerfCounters::take();
+				} catch (...) {
+					state.error = current_exception();
+				}
+			});
+		}
+		{
+			Trace::Scope scope("wait for workers");
+			for(unsigned int i = 0; i < threads; i++)
+			{
+				workers[i].join();
+			}
+		}
+		for(unsigned int i = 0; i < threads; i++)
+		{
+			if (states[i].error) {
+				rethrow_exception(states[i].error);
+			}
+		}
+		auto& result = states[0].accumulators;
 		{
-			auto last_time = t0;
-			while (last_time < t0 + duration) {
-				auto t = times.back();
-				auto k = kvecs.back();
-				auto s = spins.back();
-
-				auto next_scattering =
-				    scattering_model->NextEvent(k);
-				auto next_t = t + next_scattering.t;
-				auto next_k = next_scattering.k;
-				auto next_s = magnetic_field->advance(
-				    s, t, next_t, soc_model->omega(k));
-				last_time = next_t;
-
-				times.push_back(next_t);
-				spins.push_back(next_s);
-				kvecs.push_back(next_k);
+			Trace::Scope scope("reduction");
+			for(unsigned int i = 1; i < threads; i++)
+			{
+				for (size_t j = 0; j < result.size(); j++) {
+					result[j].merge(states[i].accumulators[j]);
+				}
+			}
+			if (antithetic) {
+				auto& pairs = states[0].pair_statistics;
+				for(unsigned int i = 1; i < threads; i++)
+				{
+					pairs.merge(states[i].pair_statistics);
+				}
+				const arma::mat mean_a = pairs.a / count;
+				const arma::mat mean_b = pairs.b / count;
+				const arma::mat variance =
+				    pairs.aa / count - mean_a % mean_a +
+				    pairs.bb / count - mean_b % mean_b;
+				const arma::mat covariance =
+				    pairs.ab / count - mean_a % mean_b;
+				independent_variance += arma::accu(variance);
+				antithetic_variance +=
+				    arma::accu(variance + 2. * covariance);
 			}
 		}
 
-		// take samples
+		PerfCounters::Scope scope(PerfCounters::Phase::output);
+		Trace::Scope trace("output");
+		for(size_t k = first; k < last; k++)
 		{
-			size_t ind = 0;
-			double next_t = times[1];
-			for (size_t i = 0; i < size; i++) {
-				while (t0 + i * time_step > next_t) {
-					ind++;
-					next_t = times[ind + 1];
+			auto record = vector<double>{grid.times[k]};
+			for (const auto& accumulator : result) {
+				const auto& values = accumulator.values();
+				for (size_t j = 0; j < values.n_rows; j++) {
+					record.push_back(values(j, k - first) /
+							 spin_count);
 				}
-				auto s = spins[ind];
-				auto k = kvecs[ind];
-
-				auto st = magnetic_field->advance(
-				    s, times[ind], t0 + i * time_step,
-				    soc_model->omega(k));
-				result.col(i) +=
-				    arma::join_vert(arma::vec{0.}, st);
 			}
+			output->write_record(record);
 		}
 	}
-	return result;
-	/*
-	output->write_header({"t", "s_x", "s_y", "s_z"});
 
-	for (size_t k = 0; k < size; k++) {
-		output->write_record({
-		  k*time_step,
-		  result(1,k) / spin_count,
-		  result(2,k) / spin_count,
-		  result(3,k) / spin_count
-		});
+	auto report = Report{};
+	report.perf = PerfCounters::take();
+	for (const auto& state : states) {
+		report.workers.push_back(Report::Worker{state.start, state.end});
+		report.perf += state.perf;
+	}
+	if (antithetic && antithetic_variance > 0.) {
+		report.variance_reduction =
+		    independent_variance / antithetic_variance;
 	}
-	*/
+	// The copies of the scattering model add their statistics to it
+	states.clear();
+	report.scattering_statistics = statistics(*scattering_model);
+	return report;
 }
 
-void Ensamble::run() {
+template <typename real>
+Report Ensamble::do_run_in_time() {
 	using namespace std;
-	vector<future<arma::mat>> future_run;
-	auto size=(size_t)(duration / time_step);
-	auto result=arma::mat(4, size, arma::fill::zeros);
-	for(unsigned int i = 0; i < threads; i++)
-	{
-		future_run.push_back(async([&]{ return do_run(threads); }));
+	const auto size = grid.size();
+	const auto seed = get_random_engine()();
+	const auto cpus = Threads::cpu_order(pin);
+	PerfCounters::take();
+
+	auto header = vector<string>{"t"};
+	for (const auto& observable : observables) {
+		const auto columns = observable->columns();
+		header.insert(header.end(), columns.begin(), columns.end());
+	}
+	output->write_header(header);
+
+	auto accumulators = vector<vector<Observable::Accumulator>>(threads);
+	auto errors = vector<exception_ptr>(threads);
+	auto perf = vector<PerfCounters::Totals>(threads);
+	Trajectory::TimeSplit<real> split(
+	    *initial_condition, *scattering_model, *soc_model,
+	    magnetic_field.get(), t0, t0 + duration, threads);
+
+	vector<thread> workers;
+	for (unsigned int i = 0; i < threads; i++) {
+		workers.emplace_back([&, i] {
+			Trace::name_thread("part " + to_string(i));
+			try {
+				if (pin != Threads::Pin::none) {
+					Threads::pin_current_thread(
+					    cpus[i % cpus.size()]);
+				}
+				// Only part 0 draws, from the engine a single
+				// worker of do_run would get
+				get_random_engine().seed(seed);
+				Rotation::fast_math() = fast_math;
+				for (const auto& observable : observables) {
+					accumulators[i].emplace_back(
+					    *observable, size);
+				}
+				auto sampler = Trajectory::Sampler<real>(
+				    t0, grid, 0, size, accumulators[i]);
+				split.run(i, spin_count, sampler);
+				perf[i] = PerfCounters::take();
+			} catch (...) {
+				errors[i] = current_exception();
+			}
+		});
 	}
-	for(unsigned int i = 0; i < threads; i++)
 	{
-		future_run[i].wait();
-		result+=future_run[i].get();
+		Trace::Scope scope("wait for parts");
+		for (auto& worker : workers) {
+			worker.join();
+		}
 	}
-	output->write_header({"t","s_x","s_y","s_z"});
+	rethrow_first_error(errors);
 
-	for(size_t k = 0; k < size; k++)
+	auto& result = accumulators[0];
 	{
-		output->write_record({
-		k*time_step,
-		result(1,k) / spin_count,
-		result(2,k) / spin_count,
-		result(3,k) / spin_count		
-		});
+		Trace::Scope scope("reduction");
+		for (unsigned int i = 1; i < threads; i++) {
+			for (size_t j = 0; j < result.size(); j++) {
+				result[j].merge(accumulators[i][j]);
+			}
+		}
+	}
+	PerfCounters::Scope scope(PerfCounters::Phase::output);
+	Trace::Scope trace("output");
+	for (size_t k = 0; k < size; k++) {
+		auto record = vector<double>{grid.times[k]};
+		for (const auto& accumulator : result) {
+			const auto& values = accumulator.values();
+			for (size_t j = 0; j < values.n_rows; j++) {
+				record.push_back(values(j, k) / spin_count);
+			}
+		}
+		output->write_record(record);
+	}
+	auto report = Report{};
+	report.perf = PerfCounters::take();
+	for (const auto& totals : perf) {
+		report.perf += totals;
 	}
-	//this->run();  // TODO multithread
+	report.scattering_statistics = statistics(*scattering_model);
+	return report;
+}
+
+Report Ensamble::run() {
+	check_output(output);
+	if (parallel_in_time) {
+		if (single_precision) {
+			return do_run_in_time<float>();
+		}
+		return do_run_in_time<double>();
+	}
+	if (single_precision) {
+		return do_run<float>();
+	}
+	return do_run<double>();
+}
+
+template <typename real>
+Estimate Ensamble::do_estimate() {
+	using namespace std;
+	const auto size = grid.size();
+	const auto window_size =
+	    window == 0 ? size : min((size_t)window, size);
+	const auto count = antithetic ? spin_count / 2 : spin_count;
+	const auto rate =
+	    scattering_rate(*initial_condition, *scattering_model);
+
+	auto accumulators = vector<Observable::Accumulator>{};
+	auto accumulator_memory = size_t{0};
+	for (const auto& observable : observables) {
+		accumulators.emplace_back(*observable, window_size);
+		accumulator_memory +=
+		    observable->columns().size() * window_size * sizeof(double);
+	}
+	auto pair_statistics = Trajectory::PairStatistics(window_size);
+
+	Rotation::fast_math() = fast_math;
+	// The segments with a sampler outside of the window
+	const auto span = min(duration, calibration_events / rate);
+	auto idle = Trajectory::Sampler<real>(t0, grid, 0, 0, accumulators);
+	const auto per_time = segment_seconds<real>(
+	    Trajectory::Generator<real>(*initial_condition, *scattering_model,
+					*soc_model, magnetic_field.get(), t0,
+					t0 + span, antithetic),
+	    span, count, [&](Trajectory::Generator<real>& generator) {
+		    Trajectory::Segment<real> segment, mirrored;
+		    idle.begin(generator.initial_state());
+		    if (antithetic) {
+			    while (generator.next(segment, mirrored)) {
+				    idle.segment(segment, mirrored);
+			    }
+		    } else {
+			    while (generator.next(segment)) {
+				    idle.segment(segment);
+			    }
+		    }
+	    });
+	// The samples of the first window, scaled to the whole grid
+	auto sampler = Trajectory::Sampler<real>(
+	    t0, grid, 0, window_size, accumulators,
+	    antithetic ? &pair_statistics : nullptr);
+	const auto state = initial_condition->roll(0, count);
+	const auto samples = sample_seconds<real>(
+	    state, *soc_model, t0, duration, rate, size,
+	    [&](const vector<Trajectory::Segment<real>>& segments) {
+		    sampler.begin(state);
+		    for (const auto& segment : segments) {
+			    if (antithetic) {
+				    sampler.segment(segment, segment);
+			    } else {
+				    sampler.segment(segment);
+			    }
+		    }
+	    });
+	Rotation::fast_math() = false;
+
+	auto result = Estimate{};
+	result.events = spin_count * rate * duration;
+	result.trajectories = count;
+	result.trajectory_seconds =
+	    per_time * duration + samples * size / window_size;
+	result.threads = threads;
+	result.parallel = true;
+	result.shared_memory = 2 * size * sizeof(double);
+	result.thread_memory =
+	    accumulator_memory +
+	    (antithetic ? 15 * window_size * sizeof(double) : 0) +
+	    Trajectory::Generator<real>::memory(antithetic);
+	result.trajectory_memory =
+	    window_size < size ? sizeof(Trajectory::Checkpoint<real>) : 0;
+	if (parallel_in_time) {
+		// Without window and antithetic pairs, part 0 draws the events
+		// and the parts propagate the chunks instead of a generator
+		result.split_in_time = true;
+		result.serial_seconds =
+		    draw_seconds(*initial_condition, *scattering_model) *
+		    rate * duration;
+		result.shared_memory +=
+		    Trajectory::TimeSplit<real>::shared_memory(threads);
+		result.thread_memory = accumulator_memory +
+				       Trajectory::TimeSplit<real>::part_memory();
+	}
+	return result;
+}
+
+Estimate Ensamble::estimate() {
+	if (single_precision) {
+		return do_estimate<float>();
+	}
+	return do_estimate<double>();
 }
 
 EchoDecay::EchoDecay(
-    unsigned int spin_count, double duration, double time_step, double t0,
+    unsigned int spin_count, double duration, double time_step,
+    std::unique_ptr<TimeGrid::Base>&& time_grid, double t0,
+    Threads::Count threads,
     std::unique_ptr<InitialCondition::Base>&& initial_condition,
     std::unique_ptr<ScatteringModel::Base>&& scattering_model,
     std::unique_ptr<SOCModel::Base>&& soc_model,
     std::unique_ptr<Output::Base>&& output)
     : spin_count(spin_count),
       duration(duration),
-      time_step(time_step),
+      grid(TimeGrid::make_grid(time_grid.get(), time_step, duration)),
       t0(t0),
+      threads(threads.value),
       initial_condition(std::move(initial_condition)),
       scattering_model(std::move(scattering_model)),
       soc_model(std::move(soc_model)),
-      output(std::move(output)) {
-	if (duration <= 0) {
-		throw std::invalid_argument{"\"duration\" must be positive."};
-	}
-	if (time_step <= 0) {
-		throw std::invalid_argument{"\"time_step\" must be positive."};
-	}
-	if (time_step > duration) {
-		throw std::invalid_argument{
-		    "\"time_step\" must not be larger than \"duration\"."};
-	}
-}
+      output(std::move(output)) {}
 
-void EchoDecay::run() {
-	const auto size = (size_t)(duration / time_step);
+Report EchoDecay::run() {
+	check_output(output);
+	const auto size = grid.size();
 	auto result = arma::mat(3, size, arma::fill::zeros);
+	auto echoes = Echoes(size);
+	PerfCounters::take();
+	auto perf = std::vector<PerfCounters::Totals>(threads);
 
-	for (size_t k = 0; k < spin_count; ++k) {
-		auto rotations = std::vector<Rotation::rotation>(2 * size);
-		auto invrotations = std::vector<Rotation::rotation>(2 * size);
-
-		const auto half_step = time_step / 2.;
-		const auto initial_state = initial_condition->roll();
-		auto last_k = initial_state.k;
-		auto last_t = t0;
-		auto last_step = Rotation::rotation(
-		    arma::vec3(soc_model->omega(last_k) * half_step));
-		rotations[0] = Rotation::rotation::identity();
-		invrotations[0] = Rotation::rotation::identity();
-
-		auto next = scattering_model->NextEvent(last_k);
-		auto next_t = t0 + next.t;
-
-		// Populate rotations
-		for (size_t i = 1; i < 2 * size; ++i) {
-			if (t0 + i * half_step > next_t) {
-				rotations[i] =
-				    Rotation::rotation(arma::vec3(
-					soc_model->omega(last_k)
-					* (next_t - (t0 + (i - 1) * half_step))
-					))
-				    * rotations[i - 1];
-				invrotations[i] =
-				    Rotation::rotation(arma::vec3(
-				        - soc_model->omega(last_k)
-				        * (next_t - (t0 + (i - 1) * half_step))
-				        ))
-				    * invrotations[i - 1];
-
-				last_k = next.k;
-				last_t = next_t;
-				next = scattering_model->NextEvent(last_k);
-				next_t = last_t + next.t;
-
-				while (t0 + i * half_step > next_t) {
-					rotations[i] =
-					    Rotation::rotation(arma::vec3(
-					        soc_model->omega(last_k)
-						* (next_t - last_t)
-						))
-					    * rotations[i];
-					invrotations[i] =
-					    Rotation::rotation(arma::vec3(
-					        - soc_model->omega(last_k)
-						* (next_t - last_t)
-						))
-					    * invrotations[i];
-					last_k = next.k;
-					last_t = next_t;
-					next = scattering_model->NextEvent(last_k);
-					next_t = last_t + next.t;
+	if (threads == 1) {
+		auto generator = Trajectory::Generator<double>(
+		    *initial_condition, *scattering_model, *soc_model, nullptr,
+		    t0, t0 + duration);
+		auto echo = EchoRotations(t0, grid, echoes, result);
+		for (size_t k = 0; k < spin_count; ++k) {
+			Trajectory::run<double>(generator, k, spin_count,
+						{&echo});
+		}
+	} else {
+		Trajectory::TimeSplit<double> split(
+		    *initial_condition, *scattering_model, *soc_model, nullptr,
+		    t0, t0 + duration, threads, true);
+		auto parts = std::vector<EchoRotations>{};
+		parts.reserve(threads);
+		for (unsigned int i = 0; i < threads; ++i) {
+			parts.emplace_back(t0, grid, echoes, result);
+		}
+		auto errors = std::vector<std::exception_ptr>(threads);
+		auto workers = std::vector<std::thread>{};
+		for (unsigned int i = 1; i < threads; ++i) {
+			workers.emplace_back([&, i] {
+				Trace::name_thread("part " + std::to_string(i));
+				try {
+					split.run(i, spin_count, parts[i]);
+					perf[i] = PerfCounters::take();
+				} catch (...) {
+					errors[i] = std::current_exception();
 				}
-
-				rotations[i] =
-				    Rotation::rotation(arma::vec3(
-				        soc_model->omega(last_k)
-				        * (t0 + i * half_step - last_t)
-				        ))
-				    * rotations[i];
-				invrotations[i] =
-				    Rotation::rotation(arma::vec3(
-				        - soc_model->omega(last_k)
-				        * (t0 + i * half_step - last_t)
-				        ))
-				    * invrotations[i];
-
-				last_step = Rotation::rotation(arma::vec3(
-				    soc_model->omega(last_k) * half_step));
-
-			} else {
-				rotations[i] = last_step * rotations[i - 1];
-				invrotations[i] = last_step.inverse() * invrotations[i - 1];
-			}
+			});
 		}
-
-		// Accumulate result spin
-		const auto first_spin = initial_state.spin;
-		for (size_t i = 0; i < size; ++i) {
-			const auto rot_pulse = rotations[i];
-			const auto invrot_pulse = invrotations[i];
-			const auto invrot_echo = invrotations[2 * i];
-
-			// Right-to-left multiplication is more performant
-			const auto spin =
-			    invrot_echo
-			    * (invrot_pulse.inverse()
-			       * (rot_pulse * first_spin));
-			result.col(i) += spin;
+		// Part 0 draws the events from the engine of this thread, as
+		// the sequential run does
+		try {
+			split.run(0, spin_count, parts[0]);
+		} catch (...) {
+			errors[0] = std::current_exception();
+		}
+		{
+			Trace::Scope scope("wait for parts");
+			for (auto& worker : workers) {
+				worker.join();
+			}
 		}
+		rethrow_first_error(errors);
 	}
+	PerfCounters::Scope scope(PerfCounters::Phase::output);
+	Trace::Scope trace("output");
 	output->write_header({"t", "s_x", "s_y", "s_z"});
 
 	for (size_t k = 0; k < size; k++) {
-		output->write_record({k * time_step,
+		output->write_record({grid.times[k],
 				      result(0, k) / spin_count,
 				      result(1, k) / spin_count,
 				      result(2, k) / spin_count});
 	}
+	// This thread ran the sequential trajectories or part 0
+	auto report = Report{};
+	report.perf = PerfCounters::take();
+	for (const auto& totals : perf) {
+		report.perf += totals;
+	}
+	report.scattering_statistics = statistics(*scattering_model);
+	return report;
 }
 
-void EchoDecay::run(unsigned int) {
-	this->run();  // TODO multithread
+Report EchoDecay::run(unsigned int) {
+	return this->run();  // TODO multithread
+}
+
+Estimate EchoDecay::estimate() {
+	const auto size = grid.size();
+	const auto empty = TimeGrid::Grid{};
+	auto none = arma::mat{};
+	auto idle_echoes = Echoes(0);
+	auto idle = EchoRotations(t0, empty, idle_echoes, none);
+	auto result = arma::mat(3, size, arma::fill::zeros);
+	auto echoes = Echoes(size);
+	auto echo = EchoRotations(t0, grid, echoes, result);
+	auto estimate = echo_estimate(
+	    spin_count, duration, t0, size, *initial_condition,
+	    *scattering_model, *soc_model, idle, echo,
+	    Echoes::memory(size) + EchoRotations::memory(size));
+	if (threads > 1) {
+		// The parts share the result and the echoes, part 0 draws the
+		// events and the parts propagate the chunks instead of a
+		// generator
+		estimate.threads = threads;
+		estimate.parallel = true;
+		estimate.split_in_time = true;
+		estimate.serial_seconds =
+		    draw_seconds(*initial_condition, *scattering_model) *
+		    estimate.events / spin_count;
+		estimate.shared_memory +=
+		    3 * size * sizeof(double) + Echoes::memory(size) +
+		    Trajectory::TimeSplit<double>::shared_memory(threads);
+		estimate.thread_memory =
+		    EchoRotations::memory(size) +
+		    Trajectory::TimeSplit<double>::part_memory();
+	}
+	return estimate;
 }
 
 EchoDecayTest::EchoDecayTest(
-    unsigned int spin_count, double duration, double time_step, double t0,
+    unsigned int spin_count, double duration, double time_step,
+    std::unique_ptr<TimeGrid::Base>&& time_grid, double t0,
     std::unique_ptr<InitialCondition::Base>&& initial_condition,
     std::unique_ptr<ScatteringModel::Base>&& scattering_model,
     std::unique_ptr<SOCModel::Base>&& soc_model,
     std::unique_ptr<Output::Base>&& output)
     : spin_count(spin_count),
       duration(duration),
-      time_step(time_step),
+      grid(TimeGrid::make_grid(time_grid.get(), time_step, duration)),
       t0(t0),
       initial_condition(std::move(initial_condition)),
       scattering_model(std::move(scattering_model)),
       soc_model(std::move(soc_model)),
-      output(std::move(output)) {
-	if (duration <= 0) {
-		throw std::invalid_argument{"\"duration\" must be positive."};
-	}
-	if (time_step <= 0) {
-		throw std::invalid_argument{"\"time_step\" must be positive."};
-	}
-	if (time_step > duration) {
-		throw std::invalid_argument{
-		    "\"time_step\" must not be larger than \"duration\"."};
-	}
-}
+      output(std::move(output)) {}
 
-void EchoDecayTest::run() {
-	const auto size = (size_t)(duration / time_step);
+Report EchoDecayTest::run() {
+	check_output(output);
+	const auto size = grid.size();
 	auto result = arma::mat(3, size, arma::fill::zeros);
+	PerfCounters::take();
 
+	auto generator = Trajectory::Generator<double>(
+	    *initial_condition, *scattering_model, *soc_model, nullptr, t0,
+	    t0 + duration);
+	auto echo = EchoTestRotations(t0, grid, result);
 	for (size_t k = 0; k < spin_count; ++k) {
-		auto rotations = std::vector<Rotation::rotation>(2 * size);
-
-		const auto half_step = time_step / 2.;
-		const auto initial_state = initial_condition->roll();
-		auto last_k = initial_state.k;
-		auto last_t = t0;
-		auto last_step = Rotation::rotation(
-		    arma::vec3(soc_model->omega(last_k) * half_step));
-		rotations[0] = Rotation::rotation::identity();
-
-		auto next = scattering_model->NextEvent(last_k);
-		auto next_t = t0 + next.t;
-
-		// Populate rotations
-		for (size_t i = 1; i < 2 * size; ++i) {
-			if (t0 + i * half_step > next_t) {
-				rotations[i] =
-				    rotations[i - 1]
-				    * Rotation::rotation(arma::vec3(
-					soc_model->omega(last_k)
-					* (next_t - (t0 + (i - 1) * half_step))
-					));
-
-				last_k = next.k;
-				last_t = next_t;
-				next = scattering_model->NextEvent(last_k);
-				next_t = last_t + next.t;
-
-				while (t0 + i * half_step > next_t) {
-					rotations[i] =
-					    rotations[i]
-					    * Rotation::rotation(arma::vec3(
-					        soc_model->omega(last_k)
-						* (next_t - last_t)
-						));
-					last_k = next.k;
-					last_t = next_t;
-					next = scattering_model->NextEvent(last_k);
-					next_t = last_t + next.t;
-				}
-
-				rotations[i] =
-				    rotations[i]
-				    * Rotation::rotation(arma::vec3(
-				        soc_model->omega(last_k)
-				        * (t0 + i * half_step - last_t)
-				        ));
-
-				last_step = Rotation::rotation(arma::vec3(
-				    soc_model->omega(last_k) * half_step));
-
-			} else {
-				rotations[i] = rotations[i - 1] * last_step;
-			}
-		}
-
-		// Accumulate result spin
-		const auto first_spin = initial_state.spin;
-		for (size_t i = 0; i < size; ++i) {
-			// const auto rot_pulse = rotations[i];
-			// const auto rot_echo = rotations[2 * i];
-
-			// // Right-to-left multiplication is more performant
-			// const auto spin =
-			//     rot_pulse
-			//     * (rot_echo.inverse()
-			//        * (rot_pulse * first_spin));
-
-			const auto spin = rotations[2 * i] * first_spin;
-			result.col(i) += spin;
-		}
+		Trajectory::run<double>(generator, k, spin_count, {&echo});
 	}
+	PerfCounters::Scope scope(PerfCounters::Phase::output);
+	Trace::Scope trace("output");
 	output->write_header({"t", "s_x", "s_y", "s_z"});
 
 	for (size_t k = 0; k < size; k++) {
-		output->write_record({k * time_step,
+		output->write_record({grid.times[k],
 				      result(0, k) / spin_count,
 				      result(1, k) / spin_count,
 				      result(2, k) / spin_count});
 	}
+	auto report = Report{};
+	report.perf = PerfCounters::take();
+	report.scattering_statistics = statistics(*scattering_model);
+	return report;
 }
 
-void EchoDecayTest::run(unsigned int) {
-	this->run();  // TODO multithread
+Report EchoDecayTest::run(unsigned int) {
+	return this->run();  // TODO multithread
+}
+
+Estimate EchoDecayTest::estimate() {
+	const auto size = grid.size();
+	const auto empty = TimeGrid::Grid{};
+	auto none = arma::mat{};
+	auto idle = EchoTestRotations(t0, empty, none);
+	auto result = arma::mat(3, size, arma::fill::zeros);
+	auto echo = EchoTestRotations(t0, grid, result);
+	// The rotations are composed as the segments come, nothing is kept
+	// per sample
+	return echo_estimate(spin_count, duration, t0, size, *initial_condition,
+			     *scattering_model, *soc_model, idle, echo, 0);
 }
 
 }  // namespace Measurement
@@ -1,14 +1,29 @@
 #include "Misc.h"
 #include <armadillo>
+#include <cmath>
+#include "Rotation.h"
 
 namespace Misc {
 
+namespace {
+
+template <typename vec_type>
+vec_type Rotate_impl(const vec_type& v0, const vec_type& phi) {
+	const auto theta2 = arma::dot(phi, phi);
+	if (theta2 == 0.) return v0;
+	const auto c = Rotation::rodrigues(theta2);
+	return c.cos * v0 + c.sinc * arma::cross(phi, v0) +
+	       c.cosc * arma::dot(phi, v0) * phi;
+}
+
+}  // namespace
+
 arma::vec3 Rotate(const arma::vec3& v0, const arma::vec3& phi) {
-	double phi_scal = arma::norm(phi, 2);
-	if (phi_scal == 0.) return v0;
-	arma::vec3 dir = phi / phi_scal;
-	return cos(phi_scal) * v0 + sin(phi_scal) * arma::cross(dir, v0) +
-	       (1 - cos(phi_scal)) * arma::dot(dir, v0) * dir;
+	return Rotate_impl(v0, phi);
+}
+
+arma::fvec3 Rotate(const arma::fvec3& v0, const arma::fvec3& phi) {
+	return Rotate_impl(v0, phi);
 }
 
 }  // namespace Misc
@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std::string_literals;
+
+#include <yaml-cpp/yaml.h>
+#include <armadillo>
+
+#include "Misc.h"
+#include "Observable.h"
+
+namespace YAML {
+
+template <>
+std::unique_ptr<Observable::Base> Node::as() const {
+	auto type_name = Misc::mapat(*this, "type").as<std::string>();
+	try {
+	return Observable::Base::get_factories()
+	       .at(type_name)
+	       ->create_from_YAML(*this);
+	} catch (const std::out_of_range&) {
+		throw YAML::RepresentationException(
+		    this->Mark(), "Unrecognized type: "s + type_name);
+	}
+}
+
+}  // namespace YAML
+
+namespace Observable {
+
+namespace {
+
+const char* const components[] = {"x", "y", "z"};
+
+}  // namespace
+
+std::vector<std::string> Spin::columns() const {
+	return {"s_x", "s_y", "s_z"};
+}
+
+void Spin::accumulate(double* acc, const Sample& sample) const {
+	acc[0] += sample.spin[0];
+	acc[1] += sample.spin[1];
+	acc[2] += sample.spin[2];
+}
+
+std::vector<std::string> Projection::columns() const { return {"s.s0"}; }
+
+void Projection::accumulate(double* acc, const Sample& sample) const {
+	acc[0] += arma::dot(sample.spin, sample.initial_spin);
+}
+
+Transverse::Transverse(const arma::vec3& axis) : axis(axis) {
+	const auto length = arma::norm(axis);
+	if (length == 0.) {
+		throw std::invalid_argument{"\"axis\" must not be zero."};
+	}
+	this->axis /= length;
+}
+
+std::vector<std::string> Transverse::columns() const { return {"|s_perp|"}; }
+
+void Transverse::accumulate(double* acc, const Sample& sample) const {
+	const auto parallel = arma::dot(sample.spin, axis);
+	const auto square = arma::dot(sample.spin, sample.spin);
+	acc[0] += std::sqrt(std::max(0., square - parallel * parallel));
+}
+
+std::vector<std::string> SpinK::columns() const {
+	auto result = std::vector<std::string>{};
+	for (const auto s : components) {
+		for (const auto k : components) {
+			result.push_back("s_"s + s + " k_" + k);
+		}
+	}
+	return result;
+}
+
+void SpinK::accumulate(double* acc, const Sample& sample) const {
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = 0; j < 3; ++j) {
+			acc[3 * i + j] += sample.spin[i] * sample.k[j];
+		}
+	}
+}
+
+Moment::Moment(unsigned int order) : order(order) {
+	if (order == 0) {
+		throw std::invalid_argument{"\"order\" must be positive."};
+	}
+}
+
+std::vector<std::string> Moment::columns() const {
+	auto result = std::vector<std::string>{};
+	for (const auto s : components) {
+		result.push_back("s_"s + s + "^" + std::to_string(order));
+	}
+	return result;
+}
+
+void Moment::accumulate(double* acc, const Sample& sample) const {
+	for (size_t i = 0; i < 3; ++i) {
+		acc[i] += std::pow(sample.spin[i], order);
+	}
+}
+
+Histogram::Histogram(const std::string& quantity, unsigned int bins)
+    : bins(bins) {
+	if (bins == 0) {
+		throw std::invalid_argument{"\"bins\" must be positive."};
+	}
+	if (quantity == "angle") {
+		component = -1;
+		min = 0.;
+		width = arma::datum::pi / bins;
+		return;
+	}
+	const auto found = std::find_if(
+	    std::begin(components), std::end(components),
+	    [&](const char* c) { return quantity == "s_"s + c; });
+	if (found == std::end(components)) {
+		throw std::invalid_argument{
+		    "\"quantity\" must be s_x, s_y, s_z or angle."};
+	}
+	component = (int)(found - std::begin(components));
+	min = -1.;
+	width = 2. / bins;
+}
+
+std::vector<std::string> Histogram::columns() const {
+	const auto quantity =
+	    component < 0 ? "angle"s : "s_"s + components[component];
+	auto result = std::vector<std::string>{};
+	for (unsigned int i = 0; i < bins; ++i) {
+		// Labelled by the bin centre
+		char centre[32];
+		std::snprintf(centre, sizeof(centre), "%g",
+			      min + (i + 0.5) * width);
+		result.push_back(quantity + "@" + centre);
+	}
+	return result;
+}
+
+void Histogram::accumulate(double* acc, const Sample& sample) const {
+	double value;
+	if (component < 0) {
+		const auto norms = arma::norm(sample.spin) *
+				   arma::norm(sample.initial_spin);
+		const auto cosine =
+		    norms > 0. ? arma::dot(sample.spin, sample.initial_spin) /
+				     norms
+			       : 1.;
+		value = std::acos(std::max(-1., std::min(1., cosine)));
+	} else {
+		value = sample.spin[component];
+	}
+	// Rounding may put a value slightly outside the range
+	const auto bin = std::floor((value - min) / width);
+	acc[(size_t)std::max(0., std::min(bins - 1., bin))] += 1.;
+}
+
+}  // namespace Observable
+
+template class RegisterSubclass2<Observable::Spin,
+				 Observable::Subclass_policy>;
+template class RegisterSubclass2<Observable::Projection,
+				 Observable::Subclass_policy>;
+template class RegisterSubclass2<Observable::Transverse,
+				 Observable::Subclass_policy>;
+template class RegisterSubclass2<Observable::SpinK,
+				 Observable::Subclass_policy>;
+template class RegisterSubclass2<Observable::Moment,
+				 Observable::Subclass_policy>;
+template class RegisterSubclass2<Observable::Histogram,
+				 Observable::Subclass_policy>;
@@ -5,6 +5,7 @@
 using namespace std::string_literals;
 
 #include <yaml-cpp/yaml.h>
+#include <armadillo>
 
 #include "Misc.h"
 #include "Output.h"
@@ -13,6 +14,9 @@ namespace YAML {
 
 template <>
 std::unique_ptr<Output::Base> Node::as() const {
+	if (this->IsNull()) {
+		return nullptr;
+	}
 	const auto type_name = Misc::mapat(*this, "type").as<std::string>();
 	try {
 	return Output::Base::get_factories()
@@ -29,7 +33,14 @@ std::unique_ptr<Output::Base> Node::as() const {
 namespace Output {
 
 CSVFile::CSVFile(const std::string& path, bool header)
-    : out(new std::ofstream(path)), header(header) {}
+    : path(path), header(header) {}
+
+std::ostream& CSVFile::stream() {
+	if (!out) {
+		out.reset(new std::ofstream(path));
+	}
+	return *out;
+}
 
 void CSVFile::write_header(const std::vector<std::string>& h) {
 	auto it = h.begin();
@@ -39,12 +50,13 @@ void CSVFile::write_header(const std::vector<std::string>& h) {
 	if (it == end_it) { return; }
 
 	// Else
-	*out << "# " << *it;
+	auto& out = stream();
+	out << "# " << *it;
 	++it;
 	for (; it != end_it; ++it) {
-		*out << ", " << *it;
+		out << ", " << *it;
 	}
-	*out << '\n';
+	out << '\n';
 }
 
 void CSVFile::write_record(const std::vector<double>& r) {
@@ -55,12 +67,35 @@ void CSVFile::write_record(const std::vector<double>& r) {
 	if (it == end_it) { return; }
 
 	// Else
-	*out << *it;
+	auto& out = stream();
+	out << *it;
 	++it;
 	for (; it != end_it; ++it) {
-		*out << ", " << *it;
+		out << ", " << *it;
+	}
+	out << '\n';
+}
+
+void Memory::write_header(const std::vector<std::string>& h) {
+	header = h;
+}
+
+void Memory::write_record(const std::vector<double>& r) {
+	if (records.empty()) {
+		columns = r.size();
+	} else if (r.size() != columns) {
+		throw std::logic_error{"Records of different lengths."};
+	}
+	records.insert(records.end(), r.begin(), r.end());
+}
+
+arma::mat Memory::values() const {
+	if (columns == 0) {
+		return arma::mat(0, header.size());
 	}
-	*out << '\n';
+	// Column-major, so the transpose of the rows
+	return arma::mat(records.data(), columns, records.size() / columns)
+	    .t();
 }
 
 }  // namespace Output
@@ -0,0 +1,238 @@
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "PerfCounters.h"
+
+namespace PerfCounters {
+
+namespace {
+
+const char* const phase_names[phase_count] = {
+    "other", "generation", "propagation", "sampling", "output"};
+
+#ifdef __linux__
+
+const std::uint64_t event_configs[event_count] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+class Counter {
+       private:
+	int fd = -1;
+	// Page of the kernel for reading the counter with rdpmc
+	const volatile perf_event_mmap_page* page = nullptr;
+
+       public:
+	Counter() = default;
+	Counter(const Counter&) = delete;
+	Counter& operator=(const Counter&) = delete;
+
+	// errno if the counter cannot be opened, 0 otherwise
+	int open(std::uint64_t config) {
+		auto attr = perf_event_attr{};
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		// The calling thread on any CPU
+		fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fd < 0) {
+			return errno;
+		}
+		const auto mapped = ::mmap(nullptr, ::sysconf(_SC_PAGESIZE),
+					   PROT_READ, MAP_SHARED, fd, 0);
+		if (mapped != MAP_FAILED) {
+			page = static_cast<const volatile perf_event_mmap_page*>(
+			    mapped);
+		}
+		return 0;
+	}
+
+	bool is_open() const { return fd >= 0; }
+
+	std::uint64_t read() const {
+#if defined(__x86_64__) || defined(__i386__)
+		// The seqlock protocol of perf_event_mmap_page
+		while (page && page->cap_user_rdpmc) {
+			const auto sequence = page->lock;
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+			const auto index = page->index;
+			if (index == 0) {
+				break;
+			}
+			const auto shift = 64 - page->pmc_width;
+			const auto pmc = static_cast<std::int64_t>(
+			    std::uint64_t(__builtin_ia32_rdpmc(index - 1))
+			    << shift);
+			const auto count = page->offset + (pmc >> shift);
+			std::atomic_signal_fence(std::memory_order_seq_cst);
+			if (page->lock == sequence) {
+				return count;
+			}
+		}
+#endif
+		auto value = std::uint64_t{0};
+		if (::read(fd, &value, sizeof(value)) != sizeof(value)) {
+			return 0;
+		}
+		return value;
+	}
+
+	~Counter() {
+		if (page) {
+			::munmap(const_cast<perf_event_mmap_page*>(page),
+				 ::sysconf(_SC_PAGESIZE));
+		}
+		if (fd >= 0) {
+			::close(fd);
+		}
+	}
+};
+
+#else
+
+class Counter {
+       public:
+	int open(std::uint64_t) { return ENOSYS; }
+	bool is_open() const { return false; }
+	std::uint64_t read() const { return 0; }
+};
+
+const std::uint64_t event_configs[event_count] = {};
+
+#endif
+
+struct ThreadState {
+	bool opened = false;
+	Counter counters[event_count];
+	std::array<std::uint64_t, event_count> last{};
+	Phase phase = Phase::other;
+	Totals totals;
+
+	void open() {
+		opened = true;
+		totals.threads = 1;
+		for (size_t i = 0; i < event_count; ++i) {
+			const auto error = counters[i].open(event_configs[i]);
+			if (error != 0 && totals.error == 0) {
+				totals.error = error;
+			}
+			totals.opened[i] = counters[i].is_open();
+			last[i] = counters[i].is_open() ? counters[i].read() : 0;
+		}
+	}
+
+	// Adds the increments since the last change to the current phase
+	void update() {
+		auto& counts = totals.counts[static_cast<size_t>(phase)];
+		for (size_t i = 0; i < event_count; ++i) {
+			if (counters[i].is_open()) {
+				const auto now = counters[i].read();
+				counts[i] += now - last[i];
+				last[i] = now;
+			}
+		}
+	}
+};
+
+ThreadState& thread_state() {
+	thread_local ThreadState state;
+	return state;
+}
+
+}  // namespace
+
+Totals& Totals::operator+=(const Totals& other) {
+	for (size_t phase = 0; phase < phase_count; ++phase) {
+		for (size_t i = 0; i < event_count; ++i) {
+			counts[phase][i] += other.counts[phase][i];
+		}
+	}
+	threads += other.threads;
+	for (size_t i = 0; i < event_count; ++i) {
+		opened[i] += other.opened[i];
+	}
+	if (error == 0) {
+		error = other.error;
+	}
+	return *this;
+}
+
+std::atomic<bool>& enabled() {
+	static std::atomic<bool> on{false};
+	return on;
+}
+
+namespace detail {
+
+Phase enter(Phase phase) {
+	auto& state = thread_state();
+	if (!state.opened) {
+		state.open();
+	}
+	state.update();
+	const auto previous = state.phase;
+	state.phase = phase;
+	return previous;
+}
+
+}  // namespace detail
+
+Totals take() {
+	auto& state = thread_state();
+	if (!state.opened) {
+		return Totals{};
+	}
+	state.update();
+	const auto result = state.totals;
+	state.totals.counts = {};
+	return result;
+}
+
+void print(std::ostream& out, const Totals& totals) {
+	if (totals.threads == 0) {
+		return;
+	}
+	auto any = false;
+	for (const auto opened : totals.opened) {
+		any |= opened > 0;
+	}
+	if (!any) {
+		out << "# perf counters not available: "
+		    << std::strerror(totals.error) << '\n';
+		return;
+	}
+
+	const char* const names[event_count] = {
+	    "cycles", "instructions", "cache misses", "branch misses"};
+	for (size_t phase = 1; phase < phase_count; ++phase) {
+		const auto& counts = totals.counts[phase];
+		out << "# perf " << phase_names[phase] << ':';
+		for (size_t i = 0; i < event_count; ++i) {
+			out << (i == 0 ? " " : ", ");
+			if (totals.opened[i] == 0) {
+				out << "n/a ";
+			} else {
+				out << counts[i] << ' ';
+			}
+			out << names[i];
+			if (i == 1 && totals.opened[0] > 0 && counts[0] > 0 &&
+			    totals.opened[1] > 0) {
+				out << " (" << (double)counts[1] / counts[0]
+				    << " per cycle)";
+			}
+		}
+		out << '\n';
+	}
+}
+
+}  // namespace PerfCounters
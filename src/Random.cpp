@@ -1,8 +1,127 @@
-#include <random>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
 
 #include "Random.h"
 
+namespace {
+
+std::uint64_t rotl(std::uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+std::uint64_t splitmix64(std::uint64_t& x) {
+	auto z = (x += 0x9e3779b97f4a7c15);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+	return z ^ (z >> 31);
+}
+
+}  // namespace
+
+void Xoshiro256pp::seed(result_type seed) {
+	for (size_t i = 0; i < 4; ++i) {
+		state[i][0] = splitmix64(seed);
+	}
+
+	// Each lane is the previous one advanced by 2^128 steps
+	static const std::uint64_t jump[] = {
+	    0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa,
+	    0x39abdc4529b1661c};
+	for (size_t lane = 1; lane < lanes; ++lane) {
+		std::uint64_t s[4] = {state[0][lane - 1], state[1][lane - 1],
+				      state[2][lane - 1], state[3][lane - 1]};
+		std::uint64_t j[4] = {0, 0, 0, 0};
+		for (const auto word : jump) {
+			for (int b = 0; b < 64; ++b) {
+				if (word & std::uint64_t(1) << b) {
+					for (size_t i = 0; i < 4; ++i) {
+						j[i] ^= s[i];
+					}
+				}
+				const auto t = s[1] << 17;
+				s[2] ^= s[0];
+				s[3] ^= s[1];
+				s[1] ^= s[2];
+				s[0] ^= s[3];
+				s[2] ^= t;
+				s[3] = rotl(s[3], 45);
+			}
+		}
+		for (size_t i = 0; i < 4; ++i) {
+			state[i][lane] = j[i];
+		}
+	}
+	pos = block_size;
+}
+
+void Xoshiro256pp::refill() {
+	for (size_t n = 0; n < block_size; n += lanes) {
+		for (size_t lane = 0; lane < lanes; ++lane) {
+			auto& s0 = state[0][lane];
+			auto& s1 = state[1][lane];
+			auto& s2 = state[2][lane];
+			auto& s3 = state[3][lane];
+			block[n + lane] = rotl(s0 + s3, 23) + s0;
+			const auto t = s1 << 17;
+			s2 ^= s0;
+			s3 ^= s1;
+			s1 ^= s2;
+			s0 ^= s3;
+			s2 ^= t;
+			s3 = rotl(s3, 45);
+		}
+	}
+	pos = 0;
+}
+
 random_engine& get_random_engine(random_engine::result_type seed) {
-	static random_engine engine{seed};
+	thread_local random_engine engine{seed};
 	return engine;
 }
+
+namespace Random {
+
+AliasTable::AliasTable(const std::vector<double>& weights)
+    : probability(weights.size()), alias(weights.size()) {
+	const auto n = weights.size();
+	const auto sum = std::accumulate(weights.begin(), weights.end(), 0.);
+	if (n == 0 || !(sum > 0.) ||
+	    std::any_of(weights.begin(), weights.end(),
+			[](double w) { return w < 0.; })) {
+		throw std::invalid_argument{
+		    "Weights must be non-negative with a positive sum."};
+	}
+
+	// Scaled to a mean of 1, every entry below 1 is topped up by one
+	// above 1, which becomes its alias.
+	auto scaled = std::vector<double>(n);
+	std::vector<std::uint32_t> small, large;
+	for (size_t i = 0; i < n; ++i) {
+		scaled[i] = weights[i] * n / sum;
+		alias[i] = i;
+		(scaled[i] < 1. ? small : large).push_back(i);
+	}
+	while (!small.empty() && !large.empty()) {
+		const auto s = small.back();
+		small.pop_back();
+		const auto l = large.back();
+		probability[s] = scaled[s];
+		alias[s] = l;
+		scaled[l] = (scaled[l] + scaled[s]) - 1.;
+		if (scaled[l] < 1.) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	// Left over only by rounding
+	for (const auto i : large) {
+		probability[i] = 1.;
+	}
+	for (const auto i : small) {
+		probability[i] = 1.;
+	}
+}
+
+}  // namespace Random
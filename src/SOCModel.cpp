@@ -15,9 +15,9 @@ template <>
 std::unique_ptr<SOCModel::Base> Node::as() const {
 	auto type_name = Misc::mapat(*this,"type").as<std::string>();
 	try{
-	return SOCModel::Base::get_factories()
+	return SOCModel::flatten(SOCModel::Base::get_factories()
 	       .at(type_name)
-	       ->create_from_YAML(*this);
+	       ->create_from_YAML(*this));
 	} catch (const std::out_of_range&) {
 		throw YAML::RepresentationException(
 		    this->Mark(), "Unrecognized type: "s + type_name);
@@ -30,6 +30,10 @@ namespace SOCModel {
 
 arma::vec3 Isotropic3D::omega(const arma::vec3& k) const { return o*k; }
 
+void Isotropic3D::omega(const arma::mat& k, arma::mat& result) const {
+	result = o * k;
+}
+
 arma::vec3 Dresselhaus::omega(const arma::vec3& k) const {
 	return o*arma::vec{
 		k[0] * (k[1] * k[1] - k[2] * k[2]),
@@ -38,14 +42,66 @@ arma::vec3 Dresselhaus::omega(const arma::vec3& k) const {
 	};
 }
 
+void Dresselhaus::omega(const arma::mat& k, arma::mat& result) const {
+	// Column-wise, so that each component is one elementwise expression
+	// over contiguous memory
+	const arma::vec kx = k.col(0);
+	const arma::vec ky = k.col(1);
+	const arma::vec kz = k.col(2);
+	const arma::vec kx2 = kx % kx;
+	const arma::vec ky2 = ky % ky;
+	const arma::vec kz2 = kz % kz;
+
+	result.set_size(k.n_rows, 3);
+	result.col(0) = o * kx % (ky2 - kz2);
+	result.col(1) = o * ky % (kz2 - kx2);
+	result.col(2) = o * kz % (kx2 - ky2);
+}
+
 arma::vec3 Zeeman::omega(const arma::vec3& k) const {
 	return base_model->omega(k) + bfield;
 }
 
+void Zeeman::omega(const arma::mat& k, arma::mat& result) const {
+	base_model->omega(k, result);
+	result.each_row() += bfield.t();
+}
+
 arma::vec3 Stretch::omega(const arma::vec3& k) const {
 	return base_model->omega(k) % lambdas;  // Elementwise multiplication
 }
 
+void Stretch::omega(const arma::mat& k, arma::mat& result) const {
+	base_model->omega(k, result);
+	result.each_row() %= lambdas.t();
+}
+
+std::unique_ptr<Base> release_base_model(Zeeman& model, arma::vec3& lambdas,
+					 arma::vec3& offset) {
+	offset += lambdas % model.bfield;
+	return std::move(model.base_model);
+}
+
+std::unique_ptr<Base> release_base_model(Stretch& model, arma::vec3& lambdas,
+					 arma::vec3& /*offset*/) {
+	lambdas %= model.lambdas;
+	return std::move(model.base_model);
+}
+
+std::unique_ptr<Base> flatten(std::unique_ptr<Base> model) {
+	arma::vec3 lambdas(arma::fill::ones);
+	arma::vec3 offset(arma::fill::zeros);
+
+	auto base_model = model->release_base_model(lambdas, offset);
+	if (!base_model) {
+		return model;
+	}
+	while (auto next = base_model->release_base_model(lambdas, offset)) {
+		base_model = std::move(next);
+	}
+	return std::move(*base_model).fuse(lambdas, offset);
+}
+
 }  // namespace SOCModel
 
 template class RegisterSubclass2<SOCModel::Isotropic3D,
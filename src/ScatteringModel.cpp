@@ -1,12 +1,14 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <memory>
-#include <random>
 #include <stdexcept>
 #include <string>
+#include <vector>
 using namespace std::string_literals;
 
 #include <yaml-cpp/yaml.h>
 #include <armadillo>
-#include <boost/random/uniform_on_sphere.hpp>
 
 #include "Random.h"
 #include "ScatteringModel.h"
@@ -28,18 +30,323 @@ std::unique_ptr<ScatteringModel::Base> Node::as() const {
 	}
 }
 
+template <>
+std::unique_ptr<ScatteringModel::CrossSection::Base> Node::as() const {
+	auto type_name = Misc::mapat(*this, "type").as<std::string>();
+	try {
+	return ScatteringModel::CrossSection::Base::get_factories()
+	    .at(type_name)
+	    ->create_from_YAML(*this);
+	} catch (const std::out_of_range&) {
+		throw YAML::RepresentationException(
+		    this->Mark(), "Unrecognized type: "s + type_name);
+	}
+}
+
+template <>
+std::unique_ptr<ScatteringModel::Rate::Base> Node::as() const {
+	auto type_name = Misc::mapat(*this, "type").as<std::string>();
+	try {
+	return ScatteringModel::Rate::Base::get_factories()
+	    .at(type_name)
+	    ->create_from_YAML(*this);
+	} catch (const std::out_of_range&) {
+		throw YAML::RepresentationException(
+		    this->Mark(), "Unrecognized type: "s + type_name);
+	}
+}
+
 }  // namespace YAML
 
 namespace ScatteringModel {
 
 Event Isotropic3D::NextEvent(const arma::vec3&) {
-	boost::random::uniform_on_sphere<double, arma::vec> RandUnitVec(3);
-	std::exponential_distribution<> ExpDist(scattering_rate);
+	auto& engine = get_random_engine();
+	const auto k = Random::unit_vector(engine);
+	return Event{k, Random::exponential(engine, scattering_rate)};
+}
+
+namespace CrossSection {
+
+Table::Table(const std::vector<double>& values) : values(values) {
+	if (values.size() < 2) {
+		throw std::invalid_argument{
+		    "\"values\" needs at least two entries."};
+	}
+	if (std::any_of(values.begin(), values.end(),
+			[](double v) { return v < 0.; })) {
+		throw std::invalid_argument{"\"values\" must not be negative."};
+	}
+}
+
+double Table::density(double cos_theta) const {
+	const auto intervals = values.size() - 1;
+	const auto x = (cos_theta + 1.) / 2. * intervals;
+	const auto i = std::min((size_t)std::max(0., x), intervals - 1);
+	const auto f = x - i;
+	return (1. - f) * values[i] + f * values[i + 1];
+}
+
+Legendre::Legendre(const std::vector<double>& coefficients)
+    : coefficients(coefficients) {
+	if (coefficients.empty()) {
+		throw std::invalid_argument{
+		    "\"coefficients\" must not be empty."};
+	}
+}
+
+double Legendre::density(double cos_theta) const {
+	// Bonnet's recursion
+	auto previous = 1.;
+	auto current = cos_theta;
+	auto result = coefficients[0];
+	for (size_t l = 1; l < coefficients.size(); ++l) {
+		result += coefficients[l] * current;
+		const auto next =
+		    ((2 * l + 1) * cos_theta * current - l * previous) / (l + 1);
+		previous = current;
+		current = next;
+	}
+	return result;
+}
+
+HenyeyGreenstein::HenyeyGreenstein(double g) : g(g) {
+	if (!(std::abs(g) < 1.)) {
+		throw std::invalid_argument{"\"g\" must be in (-1, 1)."};
+	}
+}
+
+double HenyeyGreenstein::density(double cos_theta) const {
+	return (1. - g * g) / std::pow(1. + g * g - 2. * g * cos_theta, 1.5);
+}
+
+}  // namespace CrossSection
+
+namespace {
+
+// Relative excess of a rate over the majorant that is put down to rounding,
+// e.g. of |k| at the upper end of a PowerLaw
+constexpr auto majorant_tolerance = 1e-9;
+
+std::vector<double> tabulate(const CrossSection::Base& cross_section,
+			     unsigned int bins) {
+	if (bins == 0) {
+		throw std::invalid_argument{"\"bins\" must be positive."};
+	}
+	auto result = std::vector<double>(bins + 1);
+	for (size_t i = 0; i <= bins; ++i) {
+		result[i] = cross_section.density(-1. + 2. * i / bins);
+		if (!(result[i] >= 0.)) {
+			throw std::invalid_argument{
+			    "\"cross_section\" must not be negative."};
+		}
+	}
+	return result;
+}
 
-	return Event{RandUnitVec(get_random_engine()),
-		     ExpDist(get_random_engine())};
+// Trapezoids of the linear interpolation
+std::vector<double> interval_weights(const std::vector<double>& nodes) {
+	auto result = std::vector<double>(nodes.size() - 1);
+	for (size_t i = 0; i < result.size(); ++i) {
+		result[i] = nodes[i] + nodes[i + 1];
+	}
+	return result;
+}
+
+}  // namespace
+
+Anisotropic3D::Anisotropic3D(
+    double scattering_rate,
+    std::unique_ptr<CrossSection::Base>&& cross_section, unsigned int bins)
+    : scattering_rate(scattering_rate),
+      nodes(tabulate(*cross_section, bins)),
+      intervals(interval_weights(nodes)) {}
+
+Event Anisotropic3D::NextEvent(const arma::vec3& k0) {
+	auto& engine = get_random_engine();
+	const auto norm = arma::norm(k0);
+	if (norm == 0.) {
+		const auto k = Random::unit_vector(engine);
+		return Event{k, Random::exponential(engine, scattering_rate)};
+	}
+
+	// cos theta on interval i, from the linear density between a and b
+	// by inverting its integral
+	const auto i = intervals(engine);
+	const auto a = nodes[i];
+	const auto b = nodes[i + 1];
+	const auto u = Random::uniform(engine);
+	const auto denominator = a + std::sqrt(a * a + (b * b - a * a) * u);
+	const auto x = denominator > 0. ? u * (a + b) / denominator : u;
+	const auto bins = nodes.size() - 1;
+	const auto cos_theta =
+	    std::min(1., -1. + 2. * (i + x) / bins);
+	const auto sin_theta = std::sqrt(1. - cos_theta * cos_theta);
+
+	// Orthonormal frame around the direction of k0
+	const arma::vec3 axis = k0 / norm;
+	const arma::vec3 helper = std::abs(axis[0]) < 0.9
+				      ? arma::vec3{1., 0., 0.}
+				      : arma::vec3{0., 1., 0.};
+	const arma::vec3 e1 = arma::normalise(arma::cross(axis, helper));
+	const arma::vec3 e2 = arma::cross(axis, e1);
+	const auto phi = 2. * arma::datum::pi * Random::uniform(engine);
+
+	const arma::vec3 k =
+	    norm * (cos_theta * axis +
+		    sin_theta * (std::cos(phi) * e1 + std::sin(phi) * e2));
+	return Event{k, Random::exponential(engine, scattering_rate)};
+}
+
+namespace Rate {
+
+PowerLaw::PowerLaw(double scattering_rate, double exponent, double k_min,
+		   double k_max)
+    : scattering_rate(scattering_rate),
+      exponent(exponent),
+      k_min(k_min),
+      k_max(k_max) {
+	if (!(scattering_rate >= 0.)) {
+		throw std::invalid_argument{
+		    "\"scattering_rate\" must not be negative."};
+	}
+	if (!(0. <= k_min && k_min <= k_max)) {
+		throw std::invalid_argument{
+		    "\"k_min\" and \"k_max\" must satisfy 0 <= k_min <= "
+		    "k_max."};
+	}
+	if (exponent < 0. && k_min == 0.) {
+		throw std::invalid_argument{
+		    "\"k_min\" must be positive for a negative exponent."};
+	}
+}
+
+double PowerLaw::rate(const arma::vec3& k) const {
+	return scattering_rate * std::pow(arma::norm(k), exponent);
+}
+
+double PowerLaw::majorant() const {
+	return scattering_rate * std::pow(exponent < 0. ? k_min : k_max,
+					  exponent);
+}
+
+Directional::Directional(const arma::vec3& axis, double rate_parallel,
+			 double rate_perpendicular)
+    : axis(axis),
+      rate_parallel(rate_parallel),
+      rate_perpendicular(rate_perpendicular) {
+	const auto norm = arma::norm(axis);
+	if (norm == 0.) {
+		throw std::invalid_argument{"\"axis\" must not be zero."};
+	}
+	this->axis /= norm;
+	if (!(rate_parallel >= 0. && rate_perpendicular >= 0.)) {
+		throw std::invalid_argument{"Rates must not be negative."};
+	}
+}
+
+double Directional::rate(const arma::vec3& k) const {
+	const auto norm = arma::norm(k);
+	if (norm == 0.) {
+		return rate_perpendicular;
+	}
+	const auto c = arma::dot(k, axis) / norm;
+	return rate_perpendicular + (rate_parallel - rate_perpendicular) * c * c;
+}
+
+double Directional::majorant() const {
+	return std::max(rate_parallel, rate_perpendicular);
+}
+
+}  // namespace Rate
+
+Thinning::Thinning(std::unique_ptr<Rate::Base>&& rate,
+		   std::unique_ptr<Base>&& base_model)
+    : rate(std::move(rate)),
+      majorant(this->rate->majorant()),
+      base_model(std::move(base_model)),
+      counters(std::make_shared<Counters>()) {
+	if (!(majorant > 0. && std::isfinite(majorant))) {
+		throw std::invalid_argument{
+		    "The majorant of \"rate\" must be positive and finite."};
+	}
+}
+
+Thinning::Thinning(const Thinning& other)
+    : rate(other.rate->clone()),
+      majorant(other.majorant),
+      base_model(other.base_model->clone()),
+      counters(std::make_shared<Counters>()),
+      parent(other.counters) {}
+
+Thinning::~Thinning() {
+	if (counters && parent) {
+		parent->events += counters->events;
+		parent->self_scattering += counters->self_scattering;
+	}
+}
+
+Event Thinning::NextEvent(const arma::vec3& k0) {
+	auto& engine = get_random_engine();
+	const auto r = rate->rate(k0);
+	if (r > majorant * (1. + majorant_tolerance)) {
+		throw std::runtime_error{
+		    "Scattering rate " + std::to_string(r) +
+		    " above the majorant " + std::to_string(majorant) +
+		    " at |k| = " + std::to_string(arma::norm(k0)) + "."};
+	}
+	if (r <= 0.) {
+		// No further event
+		counters->events.fetch_add(1, std::memory_order_relaxed);
+		return Event{k0, std::numeric_limits<double>::infinity()};
+	}
+
+	auto t = 0.;
+	std::uint64_t rejected = 0;
+	for (;;) {
+		t += Random::exponential(engine, majorant);
+		if (Random::uniform(engine) * majorant < r) {
+			break;
+		}
+		++rejected;
+	}
+	counters->events.fetch_add(1, std::memory_order_relaxed);
+	if (rejected > 0) {
+		counters->self_scattering.fetch_add(rejected,
+						    std::memory_order_relaxed);
+	}
+
+	auto event = base_model->NextEvent(k0);
+	event.t = t;
+	return event;
+}
+
+void Thinning::print_statistics(std::ostream& out) const {
+	const auto events = counters->events.load();
+	const auto self_scattering = counters->self_scattering.load();
+	const auto candidates = events + self_scattering;
+	out << "# thinning: " << events << " events, " << self_scattering
+	    << " self-scattering events, rejection rate "
+	    << (candidates > 0 ? (double)self_scattering / candidates : 0.)
+	    << " at majorant " << majorant << '\n';
+	base_model->print_statistics(out);
 }
 
 }  // namespace ScatteringModel
 template class RegisterSubclass2<ScatteringModel::Isotropic3D,
 				 ScatteringModel::Subclass_policy>;
+template class RegisterSubclass2<ScatteringModel::Anisotropic3D,
+				 ScatteringModel::Subclass_policy>;
+template class RegisterSubclass2<ScatteringModel::CrossSection::Table,
+				 ScatteringModel::CrossSection::Subclass_policy>;
+template class RegisterSubclass2<ScatteringModel::CrossSection::Legendre,
+				 ScatteringModel::CrossSection::Subclass_policy>;
+template class RegisterSubclass2<
+    ScatteringModel::CrossSection::HenyeyGreenstein,
+    ScatteringModel::CrossSection::Subclass_policy>;
+template class RegisterSubclass2<ScatteringModel::Thinning,
+				 ScatteringModel::Subclass_policy>;
+template class RegisterSubclass2<ScatteringModel::Rate::PowerLaw,
+				 ScatteringModel::Rate::Subclass_policy>;
+template class RegisterSubclass2<ScatteringModel::Rate::Directional,
+				 ScatteringModel::Rate::Subclass_policy>;
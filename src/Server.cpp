@@ -0,0 +1,484 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <yaml-cpp/yaml.h>
+
+#include "Output.h"
+#include "Server.h"
+#include "Threads.h"
+#include "dprw.h"
+
+namespace Server {
+
+namespace {
+
+// Time a client has to send its whole request
+constexpr auto request_timeout = std::chrono::seconds(10);
+// Pause of the accept loop after an error that may persist for a while
+constexpr auto accept_backoff = std::chrono::milliseconds(100);
+
+std::runtime_error system_error(const std::string& what) {
+	return std::runtime_error{what + ": " + std::strerror(errno)};
+}
+
+sockaddr_un address(const std::string& socket_path) {
+	auto result = sockaddr_un{};
+	if (socket_path.size() >= sizeof(result.sun_path)) {
+		throw std::invalid_argument{"Socket path too long: " +
+					    socket_path};
+	}
+	result.sun_family = AF_UNIX;
+	std::strcpy(result.sun_path, socket_path.c_str());
+	return result;
+}
+
+// Stream socket with buffered reading
+class Connection {
+       private:
+	int fd;
+	std::string buffer;
+	bool has_deadline = false;
+	std::chrono::steady_clock::time_point deadline;
+
+	// Waits until there is data to receive or the deadline has passed
+	void wait_readable() {
+		for (;;) {
+			const auto left =
+			    std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - std::chrono::steady_clock::now());
+			if (left.count() <= 0) {
+				throw std::runtime_error{"Request timed out."};
+			}
+			auto request = pollfd{fd, POLLIN, 0};
+			const auto ready = ::poll(&request, 1, left.count());
+			if (ready > 0) {
+				return;
+			}
+			if (ready < 0 && errno != EINTR) {
+				throw system_error("poll");
+			}
+		}
+	}
+
+	// Appends what is available to buffer, false at the end of stream
+	bool receive() {
+		if (has_deadline) {
+			wait_readable();
+		}
+		char chunk[4096];
+		const auto n = ::recv(fd, chunk, sizeof(chunk), 0);
+		if (n < 0) {
+			throw system_error("recv");
+		}
+		buffer.append(chunk, n);
+		return n > 0;
+	}
+
+       public:
+	explicit Connection(int fd) : fd(fd) {}
+	~Connection() { ::close(fd); }
+	Connection(const Connection&) = delete;
+	Connection& operator=(const Connection&) = delete;
+
+	static std::unique_ptr<Connection> connect(
+	    const std::string& socket_path) {
+		const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			throw system_error("socket");
+		}
+		auto result = std::make_unique<Connection>(fd);
+		const auto addr = address(socket_path);
+		if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+			throw system_error("connect to " + socket_path);
+		}
+		return result;
+	}
+
+	// Line without the '\n', false at the end of stream
+	bool read_line(std::string& line) {
+		auto end = buffer.find('\n');
+		while (end == std::string::npos) {
+			if (!receive()) {
+				return false;
+			}
+			end = buffer.find('\n');
+		}
+		line = buffer.substr(0, end);
+		buffer.erase(0, end + 1);
+		return true;
+	}
+
+	std::string read(size_t size) {
+		while (buffer.size() < size) {
+			if (!receive()) {
+				throw std::runtime_error{"Connection closed."};
+			}
+		}
+		auto result = buffer.substr(0, size);
+		buffer.erase(0, size);
+		return result;
+	}
+
+	void write(const std::string& data) {
+		for (size_t sent = 0; sent < data.size();) {
+			// No SIGPIPE if the other side is gone
+			const auto n = ::send(fd, data.data() + sent,
+					      data.size() - sent, MSG_NOSIGNAL);
+			if (n < 0) {
+				throw system_error("send");
+			}
+			sent += n;
+		}
+	}
+
+	// Receiving fails once time is reached
+	void set_deadline(std::chrono::steady_clock::time_point time) {
+		has_deadline = true;
+		deadline = time;
+	}
+};
+
+// Sends the records of a job to its client as they are written
+class SocketOutput : public Output::Base {
+       private:
+	Connection& connection;
+
+	template <typename T>
+	void write_line(const char* prefix, const std::vector<T>& values) {
+		std::ostringstream line;
+		line.precision(std::numeric_limits<double>::max_digits10);
+		line << prefix;
+		for (size_t i = 0; i < values.size(); ++i) {
+			line << (i == 0 ? "" : ", ") << values[i];
+		}
+		line << '\n';
+		connection.write(line.str());
+	}
+
+       public:
+	explicit SocketOutput(Connection& connection)
+	    : connection(connection) {}
+
+	void write_header(const std::vector<std::string>& h) override {
+		write_line("# ", h);
+	}
+	void write_record(const std::vector<double>& r) override {
+		write_line("", r);
+	}
+};
+
+struct Job {
+	int priority;
+	random_engine::result_type seed;
+	std::uint64_t sequence;
+	std::shared_ptr<Connection> connection;
+	std::string config;
+	dprw::Options options;
+};
+
+// Highest priority first, then first come first served
+struct Later {
+	bool operator()(const Job& a, const Job& b) const {
+		if (a.priority != b.priority) {
+			return a.priority < b.priority;
+		}
+		return a.sequence > b.sequence;
+	}
+};
+
+class JobQueue {
+       private:
+	std::mutex mutex;
+	std::condition_variable available;
+	std::priority_queue<Job, std::vector<Job>, Later> jobs;
+	bool closed = false;
+
+       public:
+	void push(Job&& job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push(std::move(job));
+		}
+		available.notify_one();
+	}
+
+	// Waits for the next job, false once the queue is closed and empty
+	bool pop(Job& job) {
+		std::unique_lock<std::mutex> lock(mutex);
+		available.wait(lock, [&] { return closed || !jobs.empty(); });
+		if (jobs.empty()) {
+			return false;
+		}
+		job = jobs.top();
+		jobs.pop();
+		return true;
+	}
+
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		available.notify_all();
+	}
+};
+
+// Threads reading the requests, one per connection, so that a slow client
+// does not hold up the others
+class Readers {
+       private:
+	std::mutex mutex;
+	std::condition_variable finished;
+	unsigned int running = 0;
+
+       public:
+	template <typename F>
+	void start(F&& read) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			++running;
+		}
+		std::thread([this, read] {
+			read();
+			// Under the lock, wait cannot return before this thread
+			// is done with the object
+			std::lock_guard<std::mutex> lock(mutex);
+			--running;
+			finished.notify_all();
+		}).detach();
+	}
+
+	// Waits for all readers, each ends by its deadline
+	void wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return running == 0; });
+	}
+};
+
+// Removes a socket left at socket_path, anything else there is an error
+void remove_stale_socket(const std::string& socket_path) {
+	struct stat status;
+	if (::lstat(socket_path.c_str(), &status) != 0) {
+		if (errno == ENOENT) {
+			return;
+		}
+		throw system_error("lstat " + socket_path);
+	}
+	if (!S_ISSOCK(status.st_mode)) {
+		throw std::runtime_error{socket_path +
+					 " exists and is not a socket."};
+	}
+	if (::unlink(socket_path.c_str()) != 0) {
+		throw system_error("unlink " + socket_path);
+	}
+}
+
+std::string one_line(std::string message) {
+	std::replace(message.begin(), message.end(), '\n', ' ');
+	return message;
+}
+
+// Runs jobs with at most threads worker threads each
+void work(JobQueue& queue, unsigned int threads) {
+	Threads::thread_limit() = threads;
+	Job job;
+	while (queue.pop(job)) {
+		auto& connection = *job.connection;
+		try {
+			const auto result = dprw::run(
+			    YAML::Load(job.config), job.options,
+			    std::make_unique<SocketOutput>(connection), job.seed);
+			connection.write("done " +
+					 std::to_string(result.seconds) + '\n');
+		} catch (const std::exception& e) {
+			std::clog << "# job " << job.sequence
+				  << " failed: " << one_line(e.what()) << '\n';
+			try {
+				connection.write("error " + one_line(e.what()) +
+						 '\n');
+			} catch (const std::exception&) {
+				// The client is gone
+			}
+		}
+		job.connection.reset();
+	}
+}
+
+// Reads the request of a new connection, false for a shutdown request
+bool read_request(std::shared_ptr<Connection> connection,
+		  std::uint64_t sequence, JobQueue& queue) {
+	connection->set_deadline(std::chrono::steady_clock::now() +
+				 request_timeout);
+	std::string line;
+	if (!connection->read_line(line)) {
+		return true;
+	}
+	if (line == "shutdown") {
+		return false;
+	}
+	auto job = Job{};
+	job.sequence = sequence;
+	job.connection = connection;
+	std::istringstream header(line);
+	std::string command;
+	size_t option_count, config_size;
+	if (!(header >> command >> job.priority >> option_count >>
+	      config_size) ||
+	    command != "job") {
+		throw std::runtime_error{"Malformed request: " + line};
+	}
+	// The seed is optional
+	random_engine::result_type seed;
+	if (header >> seed) {
+		job.seed = seed;
+	} else if (header.eof()) {
+		job.seed = random_engine::default_seed;
+	} else {
+		throw std::runtime_error{"Malformed request: " + line};
+	}
+	for (size_t i = 0; i < option_count; ++i) {
+		std::string name, value;
+		if (!connection->read_line(name) ||
+		    !connection->read_line(value)) {
+			throw std::runtime_error{"Connection closed."};
+		}
+		job.options[name] = value;
+	}
+	job.config = connection->read(config_size);
+	queue.push(std::move(job));
+	return true;
+}
+
+}  // namespace
+
+void serve(const std::string& socket_path, unsigned int workers) {
+	const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		throw system_error("socket");
+	}
+	const Connection listener(fd);
+	const auto addr = address(socket_path);
+	remove_stale_socket(socket_path);
+	if (::bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) {
+		throw system_error("bind to " + socket_path);
+	}
+	if (::listen(fd, SOMAXCONN) != 0) {
+		throw system_error("listen");
+	}
+	// The jobs running at once share the machine
+	const auto threads =
+	    std::max(1u, Threads::hardware_concurrency() / workers);
+	std::clog << "# serving on " << socket_path << " with " << workers
+		  << " workers of up to " << threads << " threads\n";
+
+	JobQueue queue;
+	auto pool = std::vector<std::thread>{};
+	for (unsigned int i = 0; i < workers; ++i) {
+		pool.emplace_back(work, std::ref(queue), threads);
+	}
+
+	// A shutdown request stops accepting by shutting the listener down
+	std::atomic<bool> stopping{false};
+	Readers readers;
+	for (std::uint64_t sequence = 0;; ++sequence) {
+		const auto client = ::accept(fd, nullptr, nullptr);
+		if (client < 0) {
+			if (stopping) {
+				break;
+			}
+			const auto error = errno;
+			if (error == EINTR) {
+				continue;
+			}
+			// A connection aborted before it was accepted only
+			// concerns its client. The others, such as running out
+			// of file descriptors or buffers, pass once jobs end.
+			std::clog << "# accept: " << std::strerror(error) << '\n';
+			if (error != ECONNABORTED && error != EPROTO) {
+				std::this_thread::sleep_for(accept_backoff);
+			}
+			continue;
+		}
+		auto connection = std::make_shared<Connection>(client);
+		readers.start([connection, sequence, fd, &queue, &stopping] {
+			try {
+				if (!read_request(connection, sequence, queue)) {
+					stopping = true;
+					::shutdown(fd, SHUT_RDWR);
+				}
+			} catch (const std::exception& e) {
+				try {
+					connection->write("error " +
+							  one_line(e.what()) + '\n');
+				} catch (const std::exception&) {
+				}
+			}
+		});
+	}
+
+	readers.wait();
+	queue.close();
+	for (auto& worker : pool) {
+		worker.join();
+	}
+	::unlink(socket_path.c_str());
+}
+
+void submit(const std::string& socket_path, const std::string& config,
+	    const dprw::Options& options, int priority, std::ostream& out,
+	    random_engine::result_type seed) {
+	for (const auto& option : options) {
+		if (option.first.find('\n') != std::string::npos ||
+		    option.second.find('\n') != std::string::npos) {
+			throw std::invalid_argument{
+			    "Options must not contain line breaks."};
+		}
+	}
+	auto connection = Connection::connect(socket_path);
+	std::ostringstream request;
+	request << "job " << priority << ' ' << options.size() << ' '
+		<< config.size() << ' ' << seed << '\n';
+	for (const auto& option : options) {
+		request << option.first << '\n' << option.second << '\n';
+	}
+	request << config;
+	connection->write(request.str());
+
+	for (std::string line; connection->read_line(line);) {
+		if (line.compare(0, 5, "done ") == 0) {
+			return;
+		}
+		if (line.compare(0, 6, "error ") == 0) {
+			throw std::runtime_error{line.substr(6)};
+		}
+		out << line << '\n';
+	}
+	throw std::runtime_error{"Connection closed before the job finished."};
+}
+
+void shutdown(const std::string& socket_path) {
+	Connection::connect(socket_path)->write("shutdown\n");
+}
+
+}  // namespace Server
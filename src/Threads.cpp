@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "Threads.h"
+
+namespace Threads {
+
+namespace {
+
+// Parses a sysfs CPU list such as "0-3,8-11"
+std::vector<int> parse_cpu_list(const std::string& list) {
+	auto result = std::vector<int>{};
+	std::istringstream in(list);
+	for (std::string range; std::getline(in, range, ',');) {
+		const auto dash = range.find('-');
+		try {
+			const auto first = std::stoi(range.substr(0, dash));
+			const auto last =
+			    dash == std::string::npos
+				? first
+				: std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; ++cpu) {
+				result.push_back(cpu);
+			}
+		} catch (const std::logic_error&) {
+			// Empty or malformed entry
+		}
+	}
+	return result;
+}
+
+std::vector<int> allowed_cpus() {
+	auto result = std::vector<int>{};
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &set)) {
+				result.push_back(cpu);
+			}
+		}
+	}
+#endif
+	if (result.empty()) {
+		const auto n = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int cpu = 0; cpu < n; ++cpu) {
+			result.push_back(cpu);
+		}
+	}
+	return result;
+}
+
+// Path of the cgroup of the process from /proc/self/cgroup, in the v1
+// hierarchy with the controller or in the v2 hierarchy if controller is
+// empty, "/" if it is not listed
+std::string own_cgroup(const std::string& controller) {
+	std::ifstream in("/proc/self/cgroup");
+	for (std::string line; std::getline(in, line);) {
+		// "<hierarchy id>:<controllers>:<path>"
+		const auto first = line.find(':');
+		const auto second = line.find(':', first + 1);
+		if (first == std::string::npos || second == std::string::npos) {
+			continue;
+		}
+		const auto controllers =
+		    line.substr(first + 1, second - first - 1);
+		const auto path = line.substr(second + 1);
+		if (controller.empty()) {
+			if (controllers.empty()) {
+				return path;
+			}
+			continue;
+		}
+		std::istringstream list(controllers);
+		for (std::string name; std::getline(list, name, ',');) {
+			if (name == controller) {
+				return path;
+			}
+		}
+	}
+	return "/";
+}
+
+// CPUs allowed by the quota of the cgroup directory, 0 if it has no quota or
+// cannot be read
+unsigned int quota_limit(const std::string& directory, bool v2) {
+	double quota = -1.;
+	double period = 0.;
+	if (v2) {
+		// "<quota> <period>" or "max <period>"
+		std::ifstream cpu_max(directory + "/cpu.max");
+		std::string quota_str;
+		if (cpu_max >> quota_str >> period && quota_str != "max") {
+			try {
+				quota = std::stod(quota_str);
+			} catch (const std::logic_error&) {
+			}
+		}
+	} else {
+		std::ifstream quota_file(directory + "/cpu.cfs_quota_us");
+		std::ifstream period_file(directory + "/cpu.cfs_period_us");
+		if (!(quota_file >> quota) || !(period_file >> period)) {
+			quota = -1.;
+		}
+	}
+
+	if (quota <= 0. || period <= 0.) {
+		return 0;
+	}
+	return std::max(1u, (unsigned int)std::ceil(quota / period));
+}
+
+// CPUs allowed by the cgroup quota, 0 if there is no quota
+//
+// The quota of the cgroup of the process and of all its ancestors apply, so
+// the smallest one is taken. Outside a cgroup namespace the path of the
+// cgroup is below the mount point, in a container without one it may not
+// exist there and only the ancestors that do are read, down to the mount
+// point itself.
+unsigned int cgroup_cpu_limit() {
+	const auto v2 =
+	    std::ifstream("/sys/fs/cgroup/cgroup.controllers").good();
+	const std::string mount = v2 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/cpu";
+	auto path = own_cgroup(v2 ? "" : "cpu");
+
+	unsigned int result = 0;
+	for (;;) {
+		const auto limit = quota_limit(mount + path, v2);
+		if (limit != 0 && (result == 0 || limit < result)) {
+			result = limit;
+		}
+		const auto slash = path.find_last_of('/');
+		if (path.empty() || path == "/" || slash == std::string::npos) {
+			break;
+		}
+		// "/a/b" -> "/a" -> "" (the mount point)
+		path.erase(slash);
+	}
+	return result;
+}
+
+// NUMA node of each CPU, index is the CPU number
+std::vector<int> cpu_nodes() {
+	auto result = std::vector<int>{};
+	for (int node = 0;; ++node) {
+		std::ifstream cpulist("/sys/devices/system/node/node" +
+				      std::to_string(node) + "/cpulist");
+		std::string list;
+		if (!std::getline(cpulist, list)) {
+			break;
+		}
+		for (const auto cpu : parse_cpu_list(list)) {
+			if ((size_t)cpu >= result.size()) {
+				result.resize(cpu + 1, -1);
+			}
+			result[cpu] = node;
+		}
+	}
+	return result;
+}
+
+int node_of(const std::vector<int>& nodes, int cpu) {
+	if (cpu < 0) {
+		return -1;
+	}
+	if ((size_t)cpu >= nodes.size() || nodes[cpu] < 0) {
+		return 0;
+	}
+	return nodes[cpu];
+}
+
+}  // namespace
+
+unsigned int hardware_concurrency() {
+	const auto cpus = (unsigned int)allowed_cpus().size();
+	const auto limit = cgroup_cpu_limit();
+	return limit == 0 ? cpus : std::min(cpus, limit);
+}
+
+unsigned int& thread_limit() {
+	thread_local unsigned int limit = 0;
+	return limit;
+}
+
+std::vector<int> cpu_order(Pin pin) {
+	const auto cpus = allowed_cpus();
+	if (pin != Pin::scatter) {
+		// Node by node, each node in CPU number order
+		const auto nodes = cpu_nodes();
+		auto result = cpus;
+		std::stable_sort(result.begin(), result.end(), [&](int a, int b) {
+			return node_of(nodes, a) < node_of(nodes, b);
+		});
+		return result;
+	}
+
+	// Round-robin over the nodes
+	const auto nodes = cpu_nodes();
+	auto per_node = std::vector<std::vector<int>>{};
+	for (const auto cpu : cpus) {
+		const auto node = (size_t)node_of(nodes, cpu);
+		if (node >= per_node.size()) {
+			per_node.resize(node + 1);
+		}
+		per_node[node].push_back(cpu);
+	}
+	auto result = std::vector<int>{};
+	for (size_t i = 0; result.size() < cpus.size(); ++i) {
+		for (const auto& node_cpus : per_node) {
+			if (i < node_cpus.size()) {
+				result.push_back(node_cpus[i]);
+			}
+		}
+	}
+	return result;
+}
+
+bool pin_current_thread(int cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+Placement current_placement() {
+#ifdef __linux__
+	const auto cpu = sched_getcpu();
+#else
+	const auto cpu = -1;
+#endif
+	return Placement{cpu, node_of(cpu_nodes(), cpu)};
+}
+
+}  // namespace Threads
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std::string_literals;
+
+#include <yaml-cpp/yaml.h>
+
+#include "Misc.h"
+#include "TimeGrid.h"
+
+namespace YAML {
+
+template <>
+std::unique_ptr<TimeGrid::Base> Node::as() const {
+	if (this->IsNull()) {
+		return nullptr;
+	}
+	auto type_name = Misc::mapat(*this, "type").as<std::string>();
+	try {
+	return TimeGrid::Base::get_factories()
+	       .at(type_name)
+	       ->create_from_YAML(*this);
+	} catch (const std::out_of_range&) {
+		throw YAML::RepresentationException(
+		    this->Mark(), "Unrecognized type: "s + type_name);
+	}
+}
+
+}  // namespace YAML
+
+namespace TimeGrid {
+
+namespace {
+
+// Sets the steps of an irregular grid to the distances of the times
+void set_steps(Grid& grid, double duration) {
+	grid.steps.resize(grid.times.size());
+	for (size_t i = 0; i + 1 < grid.times.size(); ++i) {
+		grid.steps[i] = grid.times[i + 1] - grid.times[i];
+	}
+	if (!grid.steps.empty()) {
+		grid.steps.back() = duration - grid.times.back();
+	}
+}
+
+}  // namespace
+
+Uniform::Uniform(double time_step) : time_step(time_step) {
+	if (time_step <= 0) {
+		throw std::invalid_argument{"\"time_step\" must be positive."};
+	}
+}
+
+Grid Uniform::grid(double duration) const {
+	if (time_step > duration) {
+		throw std::invalid_argument{
+		    "\"time_step\" must not be larger than \"duration\"."};
+	}
+	const auto size = (size_t)(duration / time_step);
+	auto result = Grid{};
+	result.times.resize(size);
+	result.steps.assign(size, time_step);
+	for (size_t i = 0; i < size; ++i) {
+		result.times[i] = i * time_step;
+	}
+	return result;
+}
+
+Logarithmic::Logarithmic(double first, unsigned int points)
+    : first(first), points(points) {
+	if (first <= 0) {
+		throw std::invalid_argument{"\"first\" must be positive."};
+	}
+	if (points < 2) {
+		throw std::invalid_argument{"\"points\" must be at least 2."};
+	}
+}
+
+Grid Logarithmic::grid(double duration) const {
+	if (first >= duration) {
+		throw std::invalid_argument{
+		    "\"first\" must be smaller than \"duration\"."};
+	}
+	auto result = Grid{};
+	result.times.push_back(0.);
+	const auto ratio = std::log(duration / first) / (points - 1);
+	for (unsigned int i = 0; i + 1 < points; ++i) {
+		result.times.push_back(first * std::exp(i * ratio));
+	}
+	set_steps(result, duration);
+	return result;
+}
+
+Piecewise::Piecewise(const std::vector<double>& breaks,
+		     const std::vector<double>& time_steps)
+    : breaks(breaks), time_steps(time_steps) {
+	if (breaks.size() != time_steps.size() + 1) {
+		throw std::invalid_argument{
+		    "\"breaks\" must have one more entry than \"time_steps\"."};
+	}
+	if (breaks.front() != 0.) {
+		throw std::invalid_argument{"\"breaks\" must start at 0."};
+	}
+	for (size_t i = 0; i < time_steps.size(); ++i) {
+		if (breaks[i + 1] <= breaks[i]) {
+			throw std::invalid_argument{
+			    "\"breaks\" must be increasing."};
+		}
+		if (time_steps[i] <= 0) {
+			throw std::invalid_argument{
+			    "\"time_steps\" must be positive."};
+		}
+	}
+}
+
+Grid Piecewise::grid(double duration) const {
+	auto result = Grid{};
+	for (size_t i = 0; i < time_steps.size() && breaks[i] < duration; ++i) {
+		const auto end = std::min(breaks[i + 1], duration);
+		const auto step = time_steps[i];
+		for (size_t j = 0;; ++j) {
+			const auto t = breaks[i] + j * step;
+			if (t >= end) {
+				break;
+			}
+			result.times.push_back(t);
+			result.steps.push_back(step);
+		}
+		// The next piece starts at end, not necessarily a multiple of
+		// step away
+		if (!result.times.empty()) {
+			result.steps.back() = end - result.times.back();
+		}
+	}
+	return result;
+}
+
+File::File(const std::string& path) {
+	std::ifstream in(path);
+	if (!in) {
+		throw std::invalid_argument{"Cannot open \"" + path + "\"."};
+	}
+	for (std::string line; std::getline(in, line);) {
+		std::istringstream fields(line.substr(0, line.find('#')));
+		double t;
+		if (fields >> t) {
+			if (!times.empty() && t <= times.back()) {
+				throw std::invalid_argument{
+				    "The times in \"" + path +
+				    "\" must be increasing."};
+			}
+			times.push_back(t);
+		}
+	}
+	if (times.empty() || times.front() < 0.) {
+		throw std::invalid_argument{
+		    "\"" + path + "\" must contain non-negative times."};
+	}
+}
+
+Grid File::grid(double duration) const {
+	if (times.back() >= duration) {
+		throw std::invalid_argument{
+		    "The times must be smaller than \"duration\"."};
+	}
+	auto result = Grid{times, {}};
+	set_steps(result, duration);
+	return result;
+}
+
+Grid make_grid(const Base* time_grid, double time_step, double duration) {
+	if (duration <= 0) {
+		throw std::invalid_argument{"\"duration\" must be positive."};
+	}
+	if (time_grid && time_step != 0.) {
+		throw std::invalid_argument{
+		    "Only one of \"time_step\" and \"time_grid\" may be "
+		    "given."};
+	}
+	auto result = time_grid ? time_grid->grid(duration)
+				: Uniform(time_step).grid(duration);
+	if (result.size() == 0) {
+		throw std::invalid_argument{"The time grid is empty."};
+	}
+	return result;
+}
+
+}  // namespace TimeGrid
+
+template class RegisterSubclass2<TimeGrid::Uniform, TimeGrid::Subclass_policy>;
+template class RegisterSubclass2<TimeGrid::Logarithmic,
+				 TimeGrid::Subclass_policy>;
+template class RegisterSubclass2<TimeGrid::Piecewise,
+				 TimeGrid::Subclass_policy>;
+template class RegisterSubclass2<TimeGrid::File, TimeGrid::Subclass_policy>;
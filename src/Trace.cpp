@@ -0,0 +1,210 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Trace.h"
+
+namespace Trace {
+
+namespace {
+
+struct Event {
+	const char* name;
+	std::int64_t begin;
+	std::int64_t end;
+};
+
+// Written by the thread holding it only, read by write
+//
+// The events grow up to buffer_events, then the oldest are overwritten.
+struct Buffer {
+	int tid;
+	bool held = true;  // by a running thread, guarded by Registry::mutex
+	std::vector<Event> events;
+	std::atomic<std::uint64_t> head{0};  // events recorded so far
+};
+
+struct Registry {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Buffer>> buffers;
+	std::map<std::string, int> tids;  // of the named tracks
+	std::vector<std::string> names;   // by tid
+	std::string path;
+	std::int64_t start = 0;
+};
+
+Registry& registry() {
+	static Registry r;
+	return r;
+}
+
+std::string& thread_name() {
+	thread_local std::string name;
+	return name;
+}
+
+// Takes a buffer of the track of the thread on its first event, under the
+// lock of the registry, and hands it back when the thread exits. A later
+// thread of the same name continues in the same buffer, so the number of
+// buffers is bounded by the number of threads running at once.
+class Holder {
+       private:
+	Buffer* buffer = nullptr;
+
+	void acquire() {
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		auto name = thread_name();
+		if (name.empty()) {
+			name = "thread " + std::to_string(r.names.size());
+		}
+		auto it = r.tids.find(name);
+		if (it == r.tids.end()) {
+			it = r.tids.emplace(name, (int)r.names.size()).first;
+			r.names.push_back(name);
+		}
+		for (const auto& free : r.buffers) {
+			if (free->tid == it->second && !free->held) {
+				free->held = true;
+				buffer = free.get();
+				return;
+			}
+		}
+		r.buffers.push_back(std::make_unique<Buffer>());
+		buffer = r.buffers.back().get();
+		buffer->tid = it->second;
+	}
+
+       public:
+	~Holder() {
+		if (buffer) {
+			auto& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			buffer->held = false;
+		}
+	}
+
+	Buffer& get() {
+		if (!buffer) {
+			acquire();
+		}
+		return *buffer;
+	}
+};
+
+Buffer& thread_buffer() {
+	thread_local Holder holder;
+	return holder.get();
+}
+
+void write_escaped(std::ostream& out, const std::string& text) {
+	out << '"';
+	for (const auto c : text) {
+		if (c == '"' || c == '\\') {
+			out << '\\';
+		}
+		out << c;
+	}
+	out << '"';
+}
+
+void write_at_exit() {
+	const auto& path = registry().path;
+	std::ofstream file(path);
+	write(file);
+	if (!file) {
+		std::cerr << "Cannot write the trace to " << path << '\n';
+	}
+}
+
+}  // namespace
+
+std::atomic<bool>& enabled() {
+	static std::atomic<bool> on{false};
+	return on;
+}
+
+void start(const std::string& path) {
+	auto& r = registry();
+	{
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.path = path;
+		r.start = detail::now();
+	}
+	if (!enabled().exchange(true)) {
+		std::atexit(write_at_exit);
+	}
+}
+
+void name_thread(const std::string& name) {
+	if (enabled().load(std::memory_order_relaxed)) {
+		thread_name() = name;
+	}
+}
+
+namespace detail {
+
+std::int64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		   std::chrono::steady_clock::now().time_since_epoch())
+	    .count();
+}
+
+void record(const char* name, std::int64_t begin, std::int64_t end) {
+	auto& buffer = thread_buffer();
+	const auto head = buffer.head.load(std::memory_order_relaxed);
+	if (head < buffer_events) {
+		buffer.events.push_back(Event{name, begin, end});
+	} else {
+		buffer.events[head % buffer_events] = Event{name, begin, end};
+	}
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+}  // namespace detail
+
+void write(std::ostream& out) {
+	auto& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	const auto microseconds = [&r](std::int64_t ns) {
+		return (ns - r.start) / 1e3;
+	};
+
+	out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+	auto first = true;
+	const auto separator = [&first] {
+		const auto result = first ? "" : ",\n";
+		first = false;
+		return result;
+	};
+	for (size_t tid = 0; tid < r.names.size(); ++tid) {
+		out << separator() << "{\"name\":\"thread_name\",\"ph\":\"M\","
+		    << "\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":";
+		write_escaped(out, r.names[tid]);
+		out << "}}";
+	}
+	std::uint64_t dropped = 0;
+	for (const auto& buffer : r.buffers) {
+		const auto head = buffer->head.load(std::memory_order_acquire);
+		const auto begin = head > buffer_events ? head - buffer_events : 0;
+		dropped += begin;
+		for (auto i = begin; i < head; ++i) {
+			const auto& event = buffer->events[i % buffer_events];
+			out << separator() << "{\"name\":\"" << event.name
+			    << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+			    << ",\"ts\":" << microseconds(event.begin)
+			    << ",\"dur\":" << (event.end - event.begin) / 1e3
+			    << '}';
+		}
+	}
+	out << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{"
+	    << "\"dropped_events\":\"" << dropped << "\"}}\n";
+}
+
+}  // namespace Trace
@@ -0,0 +1,87 @@
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <yaml-cpp/yaml.h>
+#include <armadillo>
+
+#include "Measurement.h"
+#include "Misc.h"
+#include "Output.h"
+#include "Random.h"
+#include "dprw.h"
+#include "globals.h"
+
+namespace dprw {
+
+namespace {
+
+// Sets the options of the calling thread for its lifetime
+class ScopedOptions {
+       private:
+	Options previous;
+
+       public:
+	explicit ScopedOptions(const Options& options)
+	    : previous(std::exchange(globals::options, options)) {}
+	~ScopedOptions() { globals::options = std::move(previous); }
+	ScopedOptions(const ScopedOptions&) = delete;
+	ScopedOptions& operator=(const ScopedOptions&) = delete;
+};
+
+// The options are only read while the measurement is built, the engine is
+// seeded before as DP_random_walk starts with a fresh one
+std::unique_ptr<Measurement::Base> build(const YAML::Node& config,
+					 const Options& options,
+					 random_engine::result_type seed) {
+	get_random_engine().seed(seed);
+	const ScopedOptions scoped_options(options);
+	return config.as<std::unique_ptr<Measurement::Base>>();
+}
+
+// Fills the report and the wall time of result
+void timed_run(Measurement::Base& measurement, Result& result) {
+	const auto start = std::chrono::steady_clock::now();
+	result.report = measurement.run();
+	const std::chrono::duration<double> elapsed =
+	    std::chrono::steady_clock::now() - start;
+	result.seconds = elapsed.count();
+}
+
+}  // namespace
+
+Result run(const YAML::Node& config, const Options& options,
+	   random_engine::result_type seed) {
+	auto result = Result{};
+	result.type = Misc::mapat(config, "type").as<std::string>();
+
+	auto measurement = build(config, options, seed);
+	auto output = std::make_unique<Output::Memory>();
+	const auto& records = *output;
+	measurement->set_output(std::move(output));
+	timed_run(*measurement, result);
+	result.columns = records.get_header();
+	result.values = records.values();
+	return result;
+}
+
+Result run(const std::string& config, const Options& options,
+	   random_engine::result_type seed) {
+	return run(YAML::Load(config), options, seed);
+}
+
+Result run(const YAML::Node& config, const Options& options,
+	   std::unique_ptr<Output::Base>&& output,
+	   random_engine::result_type seed) {
+	auto result = Result{};
+	result.type = Misc::mapat(config, "type").as<std::string>();
+
+	auto measurement = build(config, options, seed);
+	measurement->set_output(std::move(output));
+	timed_run(*measurement, result);
+	return result;
+}
+
+}  // namespace dprw
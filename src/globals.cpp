@@ -2,6 +2,6 @@
 
 namespace globals {
 
-std::map<std::string, std::string> options;
+thread_local std::map<std::string, std::string> options;
 
 }  // namespace globals
@@ -1,21 +1,68 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <yaml-cpp/yaml.h>
 #include <armadillo>
 
 #include "Measurement.h"
+#include "PerfCounters.h"
+#include "Server.h"
+#include "Threads.h"
+#include "Trace.h"
 #include "cli_parser.h"
 #include "globals.h"
 
 int main(int argc, const char* argv[]) try {
 	if (argc < 2) {
-		std::cerr << "Usage: DP_random_walk <filename> [args...]'n";
+		std::cerr << "Usage: DP_random_walk <filename> [--dry-run] "
+			     "[--perf-counters] [--trace <file>] [args...]\n"
+			     "       DP_random_walk --serve <socket> "
+			     "[--workers <count>]\n";
 		return 1;
 	}
-	globals::options = cli_parser::parse(argc - 2, argv + 2);
+	if (std::strcmp(argv[1], "--serve") == 0) {
+		if (argc < 3) {
+			std::cerr << "--serve needs a socket path\n";
+			return 1;
+		}
+		const auto options = cli_parser::parse(argc - 3, argv + 3);
+		const auto workers = options.count("workers")
+					 ? std::stoul(options.at("workers"))
+					 : Threads::hardware_concurrency();
+		Server::serve(argv[2], std::max(1ul, workers));
+		return 0;
+	}
+	// --dry-run and --perf-counters take no value, so they are removed
+	// before the other options are parsed
+	auto args = std::vector<const char*>(argv + 2, argv + argc);
+	const auto flag = [&args](const char* name) {
+		const auto it = std::remove_if(
+		    args.begin(), args.end(),
+		    [name](const char* arg) { return std::strcmp(arg, name) == 0; });
+		const auto found = it != args.end();
+		args.erase(it, args.end());
+		return found;
+	};
+	const auto dry_run = flag("--dry-run");
+	PerfCounters::enabled() = flag("--perf-counters");
+
+	globals::options = cli_parser::parse(args.size(), args.data());
+	const auto trace = globals::options.find("trace");
+	if (trace != globals::options.end()) {
+		Trace::start(trace->second);
+		Trace::name_thread("main");
+		globals::options.erase(trace);
+	}
 	YAML::Node node = YAML::LoadFile(argv[1]);
 	auto measurement_uptr = node.as<std::unique_ptr<Measurement::Base>>();
-	measurement_uptr->run();
+	if (dry_run) {
+		Measurement::print(std::cout, measurement_uptr->estimate());
+		return 0;
+	}
+	Measurement::print(std::clog, measurement_uptr->run());
 	return 0;
 } catch (const YAML::Exception& e) {
 	std::cerr << "YAML Parsing error at line " << e.mark.line << std::endl;
@@ -0,0 +1,49 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "Server.h"
+#include "cli_parser.h"
+
+// Runs a job on a DP_random_walk --serve daemon and writes the records to
+// stdout
+int main(int argc, const char* argv[]) try {
+	if (argc == 3 && std::string(argv[2]) == "--shutdown") {
+		Server::shutdown(argv[1]);
+		return 0;
+	}
+	if (argc < 3) {
+		std::cerr << "Usage: DP_random_walk_client <socket> <filename> "
+			     "[--priority <n>] [--seed <n>] [args...]\n"
+			     "       DP_random_walk_client <socket> --shutdown\n";
+		return 1;
+	}
+	std::ifstream file(argv[2]);
+	if (!file) {
+		std::cerr << "Cannot read " << argv[2] << '\n';
+		return 1;
+	}
+	std::ostringstream config;
+	config << file.rdbuf();
+
+	auto options = cli_parser::parse(argc - 3, argv + 3);
+	auto priority = 0;
+	const auto priority_it = options.find("priority");
+	if (priority_it != options.end()) {
+		priority = std::stoi(priority_it->second);
+		options.erase(priority_it);
+	}
+	auto seed = random_engine::default_seed;
+	const auto seed_it = options.find("seed");
+	if (seed_it != options.end()) {
+		seed = std::stoull(seed_it->second);
+		options.erase(seed_it);
+	}
+	Server::submit(argv[1], config.str(), options, priority, std::cout,
+		       seed);
+	return 0;
+} catch (const std::exception& e) {
+	std::cerr << e.what() << '\n';
+	return 1;
+}
@@ -0,0 +1,527 @@
+// Differential test of the optimised kernels against the reference path
+//
+// Every optimised path is run next to a plain reference and compared:
+//
+// Kernels, value by value
+//   batched SOC omega(k block) against omega(k) one k at a time, and the
+//   fused chain of affine decorators built by SOCModel::flatten against the
+//   unfused chain, and a copy of the unfused chain made by clone() that
+//   outlives it. Tolerance 8 eps |omega|.
+//   Trajectory::Sampler, which reuses the rotation over one time step,
+//   against rotating the spin at the start of the segment to every sample
+//   time with Misc::Rotate, on the same segments. Tolerance 1e-12 per spin
+//   component and trajectory.
+//
+// Ensembles on the same random sequence, sample by sample
+//   precision: float and fast_math in double and single precision against
+//   the double reference, and a Piecewise time_grid equal to the uniform
+//   one. Trajectories split in time over 3 threads against the sequential
+//   run, also for a few long trajectories of Ensamble and EchoDecay that
+//   span several windows of events. The tolerances are given with each
+//   case. In float the spin of a single trajectory is off by up to about
+//   1e-6, which is the tolerance. The mean over the ensemble averages the
+//   rounding errors out, the observed deviation is 4e-9.
+//
+// Ensembles with different random sequences, statistically
+//   threads, window, antithetic pairs and the quasi random initial
+//   conditions. The mean spin at every sample time is compared with the
+//   reference by z = (mean - reference) / sqrt(se^2 + se_reference^2), the
+//   standard errors estimated from the second moments. Antithetic pairs and
+//   quasi random points reduce the variance, so their standard errors are
+//   overestimated, which is conservative. Fails for any |z| > 5.
+//
+// Samplers, Kolmogorov-Smirnov
+//   Random::uniform, exponential, normal and unit_vector,
+//   ScatteringModel::Isotropic3D, Anisotropic3D and Thinning and the quasi
+//   random initial conditions, against their distributions, 10^5 draws
+//   each. Fails for sqrt(n) D > 2.5, i.e. p < 1e-5 per test, so that all of
+//   them together pass by chance with high probability while a systematic
+//   deviation of the cumulative distribution by 0.008 is detected. The
+//   seeds are fixed, so the outcome is deterministic.
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std::string_literals;
+
+#include <yaml-cpp/yaml.h>
+#include <armadillo>
+
+#include "InitialCondition.h"
+#include "Misc.h"
+#include "Observable.h"
+#include "Random.h"
+#include "SOCModel.h"
+#include "ScatteringModel.h"
+#include "Trajectory.h"
+#include "dprw.h"
+
+namespace {
+
+constexpr auto eps = std::numeric_limits<double>::epsilon();
+constexpr auto pi = 3.14159265358979323846;
+
+auto ok = true;
+
+void report(const std::string& name, double value, double bound) {
+	const auto pass = value <= bound;
+	std::cout << (pass ? "pass " : "FAIL ") << name << ": " << value
+		  << " (bound " << bound << ")\n";
+	ok &= pass;
+}
+
+template <typename T>
+std::unique_ptr<T> load(const std::string& yaml) {
+	return YAML::Load(yaml).as<std::unique_ptr<T>>();
+}
+
+// Kernels
+
+arma::mat random_k(size_t count) {
+	auto& engine = get_random_engine();
+	auto result = arma::mat(count, 3);
+	for (size_t i = 0; i < count; ++i) {
+		const auto k = Random::unit_vector(engine);
+		for (size_t j = 0; j < 3; ++j) {
+			result(i, j) = k[j];
+		}
+	}
+	return result;
+}
+
+// Largest |a - b| relative to |reference| of row omega(k) of each
+void compare_soc(const std::string& name, const SOCModel::Base& model,
+		 const SOCModel::Base& reference, const arma::mat& k) {
+	arma::mat batched;
+	model.omega(k, batched);
+	auto worst = 0.;
+	for (size_t i = 0; i < k.n_rows; ++i) {
+		const arma::vec3 ki{k(i, 0), k(i, 1), k(i, 2)};
+		const auto expected = reference.omega(ki);
+		const auto scale = std::max(arma::norm(expected), 1.);
+		for (size_t j = 0; j < 3; ++j) {
+			worst = std::max(
+			    worst, std::abs(batched(i, j) - expected[j]) / scale);
+			worst = std::max(worst, std::abs(model.omega(ki)[j] -
+							 expected[j]) /
+						    scale);
+		}
+	}
+	report(name, worst, 8 * eps);
+}
+
+void test_soc_kernels() {
+	const auto k = random_k(1000);
+	for (const auto type : {"Isotropic3D", "Dresselhaus"}) {
+		const auto model = load<SOCModel::Base>(
+		    "{type: "s + type + ", omega: 1.3}");
+		compare_soc("batched "s + type, *model, *model, k);
+	}
+
+	// The same chain, built directly and through YAML, which flattens it
+	using namespace SOCModel;
+	const auto unfused = std::make_unique<Subclass<Zeeman>>(Zeeman(
+	    {0.1, -0.2, 0.5},
+	    std::make_unique<Subclass<Stretch>>(Stretch(
+		{1.5, 0.7, 1.},
+		std::make_unique<Subclass<Zeeman>>(Zeeman(
+		    {0.3, 0., 0.},
+		    std::make_unique<Subclass<Dresselhaus>>(
+			Dresselhaus(0.8))))))));
+	const auto fused = load<SOCModel::Base>(R"(
+type: Zeeman
+field: [0.1, -0.2, 0.5]
+base_model:
+  type: Stretch
+  lambdas: [1.5, 0.7, 1.]
+  base_model:
+    type: Zeeman
+    field: [0.3, 0., 0.]
+    base_model: {type: Dresselhaus, omega: 0.8}
+)");
+	compare_soc("batched unfused chain", *unfused, *unfused, k);
+	compare_soc("fused chain", *fused, *unfused, k);
+	// The intermediate copy is gone after this line
+	const auto copy = unfused->clone()->clone();
+	compare_soc("copied chain", *copy, *unfused, k);
+}
+
+// Sampler against rotating to every sample time from the segment start
+class ReferenceSampler : public Trajectory::Consumer<double> {
+       private:
+	double t0;
+	const TimeGrid::Grid& grid;
+	size_t next;
+
+       public:
+	arma::mat sums;
+
+	ReferenceSampler(double t0, const TimeGrid::Grid& grid)
+	    : t0(t0), grid(grid), sums(3, grid.size(), arma::fill::zeros) {}
+
+	void begin(const InitialCondition::State&) override { next = 0; }
+
+	void segment(const Trajectory::Segment<double>& segment) override {
+		for (; next < grid.size() &&
+		       t0 + grid.times[next] <= segment.t_end;
+		     ++next) {
+			sums.col(next) += Misc::Rotate(
+			    segment.spin,
+			    arma::vec3(segment.omega * (t0 + grid.times[next] -
+							segment.t_start)));
+		}
+	}
+};
+
+void test_sampler() {
+	const auto count = 200;
+	auto initial_condition = load<InitialCondition::Base>(
+	    "{type: Polarized3D, spin: [0., 0., 1.]}");
+	auto scattering_model = load<ScatteringModel::Base>(
+	    "{type: Isotropic3D, scattering_rate: 0.5}");
+	auto soc_model = load<SOCModel::Base>(
+	    "{type: Zeeman, field: [0., 0., 0.5], base_model: {type: "
+	    "Dresselhaus, omega: 2.}}");
+	const auto spin = load<Observable::Base>("{type: Spin}");
+	const auto grid = TimeGrid::make_grid(
+	    load<TimeGrid::Base>(
+		"{type: Piecewise, breaks: [0., 3., 10.], time_steps: [0.01, "
+		"0.07]}")
+		.get(),
+	    0., 10.);
+
+	auto accumulators = std::vector<Observable::Accumulator>{};
+	accumulators.emplace_back(*spin, grid.size());
+	auto sampler = Trajectory::Sampler<double>(1., grid, 0, grid.size(),
+						   accumulators);
+	auto reference = ReferenceSampler(1., grid);
+	auto generator = Trajectory::Generator<double>(
+	    *initial_condition, *scattering_model, *soc_model, nullptr, 1.,
+	    11.);
+	for (size_t i = 0; i < count; ++i) {
+		Trajectory::run<double>(generator, i, count,
+					{&sampler, &reference});
+	}
+	report("sampler step reuse",
+	       arma::abs(accumulators[0].values() - reference.sums).max(),
+	       count * 1e-12);
+}
+
+// Ensembles
+
+const auto ensemble_config = std::string{R"(
+type: Ensamble
+spin_count: 4000
+duration: 6.
+time_step: 0.2
+t0: 0.
+threads: 1
+initial_condition: {type: Polarized3D, spin: [0., 0., 1.]}
+scattering_model: {type: Isotropic3D, scattering_rate: 2.}
+magnetic_field: {type: Echo, tflip: 2.5}
+soc_model:
+  type: Zeeman
+  field: [0., 0., 0.3]
+  base_model: {type: Dresselhaus, omega: 1.5}
+observables:
+  - type: Spin
+  - {type: Moment, order: 2}
+)"};
+
+struct Ensemble {
+	arma::mat mean;  // 3 x samples
+	arma::mat se;    // standard error of mean
+};
+
+Ensemble run(const std::function<void(YAML::Node&)>& change,
+	     random_engine::result_type seed) {
+	auto config = YAML::Load(ensemble_config);
+	change(config);
+	const auto values = dprw::run(config, {}, seed).values;
+	const auto count = config["spin_count"].as<double>();
+	auto result = Ensemble{values.cols(1, 3).t(), {}};
+	const arma::mat second = values.cols(4, 6).t();
+	arma::mat variance = second - result.mean % result.mean;
+	variance.transform([](double v) { return std::max(v, 0.); });
+	result.se = arma::sqrt(variance / count);
+	return result;
+}
+
+void same_sequence(const std::string& name, const Ensemble& reference,
+		   const std::function<void(YAML::Node&)>& change,
+		   double tolerance) {
+	const auto result = run(change, random_engine::default_seed);
+	report(name, arma::abs(result.mean - reference.mean).max(), tolerance);
+}
+
+// Few trajectories with several windows of events of Trajectory::TimeSplit
+// on 3 threads
+const auto long_config = std::string{R"(
+type: Ensamble
+spin_count: 3
+duration: 6.
+time_step: 0.05
+t0: 0.
+threads: 1
+initial_condition: {type: Polarized3D, spin: [0., 0., 1.]}
+scattering_model:
+  type: Anisotropic3D
+  scattering_rate: 4000.
+  cross_section: {type: HenyeyGreenstein, g: 0.5}
+magnetic_field: {type: Echo, tflip: 2.5}
+soc_model:
+  type: Zeeman
+  field: [0., 0., 0.3]
+  base_model: {type: Dresselhaus, omega: 1.5}
+observables:
+  - type: Spin
+)"};
+
+// Largest difference of the records with change to the ones of config, on
+// the same random sequence
+double sequence_difference(const YAML::Node& config,
+			   const std::function<void(YAML::Node&)>& change) {
+	const auto reference = dprw::run(config).values;
+	auto changed = YAML::Clone(config);
+	change(changed);
+	const auto values = dprw::run(changed).values;
+	return arma::abs(values - reference).max();
+}
+
+void statistical(const std::string& name, const Ensemble& reference,
+		 const std::function<void(YAML::Node&)>& change) {
+	const auto result = run(change, random_engine::default_seed + 1);
+	auto worst = 0.;
+	for (size_t i = 0; i < result.mean.n_elem; ++i) {
+		const auto se = std::hypot(result.se[i], reference.se[i]);
+		const auto difference = std::abs(result.mean[i] - reference.mean[i]);
+		if (se == 0.) {
+			// Deterministic sample, the initial spin
+			worst = std::max(worst, difference > 1e-12 ? 1e9 : 0.);
+		} else {
+			worst = std::max(worst, difference / se);
+		}
+	}
+	report(name + " |z|", worst, 5.);
+}
+
+void test_ensembles() {
+	const auto reference =
+	    run([](YAML::Node&) {}, random_engine::default_seed);
+
+	same_sequence("float", reference,
+		      [](YAML::Node& c) { c["precision"] = "float"; }, 1e-6);
+	same_sequence("fast_math", reference,
+		      [](YAML::Node& c) { c["fast_math"] = true; }, 1e-12);
+	same_sequence("float fast_math", reference,
+		      [](YAML::Node& c) {
+			      c["precision"] = "float";
+			      c["fast_math"] = true;
+		      },
+		      1e-6);
+	same_sequence("piecewise time_grid", reference,
+		      [](YAML::Node& c) {
+			      c.remove("time_step");
+			      c["time_grid"] = YAML::Load(
+				  "{type: Piecewise, breaks: [0., 1.8, 4., 6.], "
+				  "time_steps: [0.2, 0.2, 0.2]}");
+		      },
+		      1e-12);
+
+	const auto split = [](YAML::Node& c) {
+		c["threads"] = 3;
+		c["parallel_in_time"] = true;
+	};
+	same_sequence("parallel_in_time", reference, split, 1e-12);
+	same_sequence("float parallel_in_time", reference,
+		      [&](YAML::Node& c) {
+			      split(c);
+			      c["precision"] = "float";
+		      },
+		      1e-6);
+	const auto long_ensemble = YAML::Load(long_config);
+	report("parallel_in_time long trajectories",
+	       sequence_difference(long_ensemble, split), 1e-12);
+	auto long_echo = YAML::Clone(long_ensemble);
+	long_echo["type"] = "EchoDecay";
+	long_echo.remove("magnetic_field");
+	long_echo.remove("observables");
+	report("EchoDecay threads long trajectories",
+	       sequence_difference(long_echo,
+				   [](YAML::Node& c) { c["threads"] = 3; }),
+	       1e-12);
+
+	statistical("threads", reference,
+		    [](YAML::Node& c) { c["threads"] = 3; });
+	statistical("window", reference,
+		    [](YAML::Node& c) { c["window"] = 7; });
+	statistical("antithetic", reference,
+		    [](YAML::Node& c) { c["antithetic"] = true; });
+	statistical("Fibonacci3D", reference, [](YAML::Node& c) {
+		c["initial_condition"]["type"] = "Fibonacci3D";
+	});
+	statistical("Sobol3D", reference, [](YAML::Node& c) {
+		c["initial_condition"]["type"] = "Sobol3D";
+	});
+}
+
+// Samplers
+
+// sqrt(n) times the Kolmogorov-Smirnov distance of the sample to cdf
+double ks(std::vector<double> sample,
+	  const std::function<double(double)>& cdf) {
+	std::sort(sample.begin(), sample.end());
+	const auto n = (double)sample.size();
+	auto d = 0.;
+	for (size_t i = 0; i < sample.size(); ++i) {
+		const auto f = cdf(sample[i]);
+		d = std::max({d, (i + 1) / n - f, f - i / n});
+	}
+	return std::sqrt(n) * d;
+}
+
+constexpr auto ks_bound = 2.5;
+constexpr size_t ks_count = 100000;
+
+double uniform_cdf(double x) { return std::min(1., std::max(0., x)); }
+
+double azimuth(const arma::vec3& v) {
+	return (std::atan2(v[1], v[0]) + pi) / (2 * pi);
+}
+
+void test_samplers() {
+	auto& engine = get_random_engine();
+	engine.seed(random_engine::default_seed);
+	std::vector<double> u, e, g, z, phi;
+	for (size_t i = 0; i < ks_count; ++i) {
+		u.push_back(Random::uniform(engine));
+		e.push_back(Random::exponential(engine, 2.5));
+		g.push_back(Random::normal(engine));
+		const auto v = Random::unit_vector(engine);
+		z.push_back((v[2] + 1.) / 2.);
+		phi.push_back(azimuth(v));
+	}
+	report("KS uniform", ks(u, uniform_cdf), ks_bound);
+	report("KS exponential",
+	       ks(e, [](double x) { return 1. - std::exp(-2.5 * x); }),
+	       ks_bound);
+	report("KS normal",
+	       ks(g,
+		  [](double x) { return 0.5 * std::erfc(-x / std::sqrt(2.)); }),
+	       ks_bound);
+	report("KS unit_vector z", ks(z, uniform_cdf), ks_bound);
+	report("KS unit_vector azimuth", ks(phi, uniform_cdf), ks_bound);
+
+	auto scattering_model = load<ScatteringModel::Base>(
+	    "{type: Isotropic3D, scattering_rate: 0.7}");
+	std::vector<double> t, kz;
+	auto k = arma::vec3{0., 0., 1.};
+	for (size_t i = 0; i < ks_count; ++i) {
+		const auto event = scattering_model->NextEvent(k);
+		t.push_back(event.t);
+		kz.push_back((event.k[2] + 1.) / 2.);
+		k = event.k;
+	}
+	report("KS scattering time",
+	       ks(t, [](double x) { return 1. - std::exp(-0.7 * x); }),
+	       ks_bound);
+	report("KS scattering k_z", ks(kz, uniform_cdf), ks_bound);
+
+	// Anisotropic3D, cos theta to the previous k along a chain of events
+	// and the azimuth around a fixed k0
+	const auto anisotropic = [&](const std::string& name,
+				     const std::string& cross_section,
+				     const std::function<double(double)>& cdf) {
+		auto model = load<ScatteringModel::Base>(
+		    "{type: Anisotropic3D, scattering_rate: 0.7, "
+		    "cross_section: " +
+		    cross_section + "}");
+		std::vector<double> mu, around;
+		auto norm_error = 0.;
+		auto k = arma::vec3{0., 0., 2.};
+		for (size_t i = 0; i < ks_count; ++i) {
+			const auto event = model->NextEvent(k);
+			const auto norm = arma::norm(k);
+			mu.push_back(arma::dot(event.k, k) / (norm * norm));
+			norm_error = std::max(
+			    norm_error, std::abs(arma::norm(event.k) - norm));
+			k = event.k;
+			around.push_back(
+			    azimuth(model->NextEvent(arma::vec3{0., 0., 2.}).k));
+		}
+		report("KS " + name + " cos theta", ks(mu, cdf), ks_bound);
+		report("KS " + name + " azimuth", ks(around, uniform_cdf),
+		       ks_bound);
+		report(name + " |k| per event", norm_error, 8 * eps);
+	};
+	const auto hg = 0.7;
+	anisotropic("HenyeyGreenstein", "{type: HenyeyGreenstein, g: 0.7}",
+		    [hg](double mu) {
+			    return (1. - hg * hg) / (2. * hg) *
+				   (1. / std::sqrt(1. + hg * hg - 2. * hg * mu) -
+				    1. / (1. + hg));
+		    });
+	// Piecewise linear, sampled exactly with 4 bins
+	anisotropic("Table", "{type: Table, values: [1., 3., 0.5]}, bins: 4",
+		    [](double mu) {
+			    return (mu < 0. ? (mu + 1.) * (mu + 2.)
+					    : 2. + 3. * mu - 1.25 * mu * mu) /
+				   3.75;
+		    });
+
+	// Thinning, the waiting time at fixed k against the exponential
+	// distribution at rate(k) = 1 + 2 cos^2 = 2.28
+	auto thinning = load<ScatteringModel::Base>(R"(
+type: Thinning
+rate: {type: Directional, axis: [0., 0., 1.], rate_parallel: 3.,
+       rate_perpendicular: 1.}
+base_model: {type: Isotropic3D, scattering_rate: 1.}
+)");
+	std::vector<double> waiting;
+	for (size_t i = 0; i < ks_count; ++i) {
+		waiting.push_back(
+		    thinning->NextEvent(arma::vec3{0.6, 0., 0.8}).t);
+	}
+	report("KS Thinning time",
+	       ks(waiting, [](double x) { return 1. - std::exp(-2.28 * x); }),
+	       ks_bound);
+
+	// A copy counts its events on its own and adds them to the model it
+	// was copied from when it is destroyed
+	thinning->clone()->NextEvent(arma::vec3{0.6, 0., 0.8});
+	std::ostringstream statistics;
+	thinning->print_statistics(statistics);
+	const auto events = "# thinning: " + std::to_string(ks_count + 1);
+	report("Thinning events of a copy",
+	       statistics.str().compare(0, events.size(), events) == 0 ? 0. : 1.,
+	       0.);
+
+	for (const auto type : {"Fibonacci3D", "Sobol3D"}) {
+		auto initial_condition = load<InitialCondition::Base>(
+		    "{type: "s + type + ", spin: [0., 0., 1.]}");
+		std::vector<double> qz, qphi;
+		for (size_t i = 0; i < ks_count; ++i) {
+			const auto state = initial_condition->roll(i, ks_count);
+			qz.push_back((state.k[2] + 1.) / 2.);
+			qphi.push_back(azimuth(state.k));
+		}
+		report("KS "s + type + " k_z", ks(qz, uniform_cdf), ks_bound);
+		report("KS "s + type + " azimuth", ks(qphi, uniform_cdf),
+		       ks_bound);
+	}
+}
+
+}  // namespace
+
+int main() {
+	test_soc_kernels();
+	test_sampler();
+	test_ensembles();
+	test_samplers();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// Concurrent calls of the library API
+//
+// Runs the same config, with the spin count given as an option, on several
+// threads at once and checks that every call returns the same records as a
+// call on a single thread. Every call seeds the engine of its thread with
+// the same default seed, so the results are identical. The config has no
+// output, nothing is written to files.
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <armadillo>
+
+#include "dprw.h"
+
+namespace {
+
+const auto config = std::string{R"(
+type: Ensamble
+spin_count: !option spins
+duration: 10.
+time_step: 0.5
+t0: 0.
+threads: 2
+initial_condition:
+  type: Polarized3D
+  spin: [0., 0., 1.]
+scattering_model:
+  type: Isotropic3D
+  scattering_rate: 2.
+magnetic_field:
+  type: Step
+  field: [0., 0., 1.]
+  t0: 5.
+soc_model:
+  type: Dresselhaus
+  omega: 1.
+observables:
+  - type: Spin
+  - type: Projection
+)"};
+
+const auto options = dprw::Options{{"spins", "100"}};
+
+}  // namespace
+
+int main() {
+	dprw::Result reference;
+	std::thread([&] { reference = dprw::run(config, options); }).join();
+
+	auto ok = reference.columns ==
+		      std::vector<std::string>{"t", "s_x", "s_y", "s_z",
+					       "s.s0"} &&
+		  reference.values.n_rows == 20 && reference.values.n_cols == 5;
+	if (!ok) {
+		std::cout << "unexpected shape of the result\n";
+	}
+
+	auto results = std::vector<dprw::Result>(4);
+	auto workers = std::vector<std::thread>{};
+	for (auto& result : results) {
+		workers.emplace_back(
+		    [&result] { result = dprw::run(config, options); });
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	for (const auto& result : results) {
+		if (result.values.n_rows != reference.values.n_rows ||
+		    arma::accu(arma::abs(result.values - reference.values)) !=
+			0.) {
+			std::cout << "concurrent call differs\n";
+			ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
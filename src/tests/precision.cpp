@@ -0,0 +1,60 @@
+// Reference comparison of the single and double precision propagation
+//
+// Runs the shipped Measurement.yaml with the same random sequence once with
+// "precision: double" and once with "precision: float", into an
+// Output::Memory so that no files are written, and prints the largest
+// deviation of each averaged spin component. With the shipped configuration
+// it is about 1.5e-7. The test fails from 1e-6, one unit in the last of the
+// 6 significant digits written by Output::CSVFile, far below the
+// statistical error of the ensemble average.
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+#include <armadillo>
+
+#include "Measurement.h"
+#include "Output.h"
+#include "Random.h"
+
+static arma::mat run(const std::string& precision) {
+	YAML::Node node = YAML::LoadFile("Measurement.yaml");
+	node["threads"] = 1;
+	node["precision"] = precision;
+	node.remove("output");
+
+	get_random_engine().seed(random_engine::default_seed);
+	auto measurement = node.as<std::unique_ptr<Measurement::Base>>();
+	auto output = std::make_unique<Output::Memory>();
+	const auto& records = *output;
+	measurement->set_output(std::move(output));
+	measurement->run();
+	return records.values();
+}
+
+int main() {
+	const auto reference = run("double");
+	const auto single = run("float");
+	if (reference.n_rows != single.n_rows ||
+	    reference.n_cols != single.n_cols) {
+		std::cerr << "Record count mismatch\n";
+		return 1;
+	}
+
+	auto max_error = std::vector<double>(4, 0.);
+	for (size_t i = 0; i < reference.n_rows; ++i) {
+		for (size_t j = 0; j < max_error.size(); ++j) {
+			max_error[j] = std::max(
+			    max_error[j], std::abs(reference(i, j) - single(i, j)));
+		}
+	}
+	std::cout << "max |double - float|: s_x " << max_error[1] << ", s_y "
+		  << max_error[2] << ", s_z " << max_error[3] << '\n';
+	return *std::max_element(max_error.begin(), max_error.end()) < 1e-6
+		   ? 0
+		   : 1;
+}
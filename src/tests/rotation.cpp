@@ -0,0 +1,101 @@
+// Error of the rotation kernels against the exact Rodrigues formula
+//
+// Rotates random vectors by random rotation vectors with angles from 1e-8 to
+// 1e3 with Misc::Rotate and Rotation::basic_matrix_rotation, in double and
+// single precision and with and without fast_math, and compares them with
+// Rodrigues' formula evaluated in long double. The angle theta = |phi| is
+// only known to about eps theta, so the bound is
+//   16 eps (1 + theta)
+// for the default kernel and, as the angle doublings of fast_math at most
+// double the error each,
+//   16 eps (1 + theta / sqrt(small_angle<real>::theta2))
+// for fast_math.
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+
+#include <armadillo>
+
+#include "Misc.h"
+#include "Rotation.h"
+
+namespace {
+
+using long_vec3 = long double[3];
+
+// v rotated by phi
+void reference(const long_vec3 v, const long_vec3 phi, long_vec3 result) {
+	const auto theta = std::sqrt(phi[0] * phi[0] + phi[1] * phi[1] +
+				     phi[2] * phi[2]);
+	long_vec3 k = {phi[0] / theta, phi[1] / theta, phi[2] / theta};
+	const auto c = std::cos(theta);
+	const auto s = std::sin(theta);
+	const auto kv = k[0] * v[0] + k[1] * v[1] + k[2] * v[2];
+	const long_vec3 cross = {k[1] * v[2] - k[2] * v[1],
+				 k[2] * v[0] - k[0] * v[2],
+				 k[0] * v[1] - k[1] * v[0]};
+	for (int i = 0; i < 3; ++i) {
+		result[i] = c * v[i] + s * cross[i] + (1 - c) * kv * k[i];
+	}
+}
+
+template <typename real>
+bool check(bool fast_math) {
+	using vec = Rotation::vec3<real>;
+	Rotation::fast_math() = fast_math;
+	const auto eps = (long double)std::numeric_limits<real>::epsilon();
+	const auto scale =
+	    fast_math ? 1 / std::sqrt((long double)
+					  Rotation::small_angle<real>::theta2)
+		      : 1.L;
+
+	std::mt19937 engine(42);
+	std::normal_distribution<double> normal;
+	std::uniform_real_distribution<double> exponent(-8., 3.);
+
+	auto worst = 0.L;  // largest error relative to the bound
+	for (int n = 0; n < 100000; ++n) {
+		const auto theta = std::pow(10., exponent(engine));
+		vec phi, v;
+		for (int i = 0; i < 3; ++i) {
+			phi[i] = real(normal(engine));
+			v[i] = real(normal(engine));
+		}
+		phi *= real(theta / arma::norm(arma::vec3{phi[0], phi[1],
+							  phi[2]}));
+		v /= real(arma::norm(arma::vec3{v[0], v[1], v[2]}));
+
+		const long_vec3 lphi = {phi[0], phi[1], phi[2]};
+		const long_vec3 lv = {v[0], v[1], v[2]};
+		long_vec3 expected;
+		reference(lv, lphi, expected);
+
+		const vec rotated = Misc::Rotate(v, phi);
+		const vec matrix = Rotation::basic_matrix_rotation<real>(phi) * v;
+		const auto bound = 16 * eps * (1 + theta * scale);
+		for (int i = 0; i < 3; ++i) {
+			worst = std::max(worst, std::abs(rotated[i] - expected[i]) /
+						    bound);
+			worst = std::max(worst, std::abs(matrix[i] - expected[i]) /
+						    bound);
+		}
+	}
+	std::cout << (sizeof(real) == sizeof(float) ? "float" : "double")
+		  << (fast_math ? " fast_math" : "")
+		  << ": largest error / bound " << (double)worst << '\n';
+	Rotation::fast_math() = false;
+	return worst <= 1;
+}
+
+}  // namespace
+
+int main() {
+	auto ok = true;
+	ok &= check<double>(false);
+	ok &= check<double>(true);
+	ok &= check<float>(false);
+	ok &= check<float>(true);
+	return ok ? 0 : 1;
+}